@@ -11,3 +11,127 @@ std::condition_variable g_serialCv;
 // Define the global output callback and Serial instance
 std::function<void(const std::string&)> g_outputCallback = nullptr;
 SerialClass Serial;
+
+thread_local XenoIOContext* XenoIOContext::bound_context = nullptr;
+
+XenoIOContext& XenoIOContext::getDefault() {
+    static XenoIOContext default_context;
+    return default_context;
+}
+
+XenoIOContext& XenoIOContext::current() {
+    return bound_context ? *bound_context : getDefault();
+}
+
+void XenoIOContext::write(const std::string& text) {
+    // Use global callback if set, otherwise fall back to cout.
+    if (g_outputCallback) {
+        g_outputCallback(text);
+    } else {
+        std::cout << text;
+        std::cout.flush();
+    }
+}
+
+int XenoIOContext::available() {
+    std::lock_guard<std::mutex> lk(g_serialMutex);
+    if (g_serialQueue.empty()) return 0;
+    return static_cast<int>(g_serialQueue.front().size());
+}
+
+bool XenoIOContext::readLine(std::string& line, unsigned long timeout_ms) {
+    std::unique_lock<std::mutex> lk(g_serialMutex);
+    auto ready = [] { return !g_serialQueue.empty(); };
+    if (timeout_ms == 0) {
+        g_serialCv.wait(lk, ready);
+    } else if (!g_serialCv.wait_for(lk, std::chrono::milliseconds(timeout_ms), ready)) {
+        return false;
+    }
+    line = std::move(g_serialQueue.front());
+    g_serialQueue.pop_front();
+    return true;
+}
+
+bool XenoIOContext::tryReadLine(std::string& line) {
+    std::lock_guard<std::mutex> lk(g_serialMutex);
+    if (g_serialQueue.empty()) return false;
+    line = std::move(g_serialQueue.front());
+    g_serialQueue.pop_front();
+    return true;
+}
+
+void XenoIOContext::pushInput(const std::string& line) {
+    SerialPushInput(line);
+}
+
+void XenoIOContext::sleepMs(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+unsigned long XenoIOContext::millis() {
+    auto duration = std::chrono::steady_clock::now().time_since_epoch();
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+void XenoBufferedIO::write(const std::string& text) {
+    if (output_sink) {
+        output_sink(text);
+        return;
+    }
+    std::lock_guard<std::mutex> lk(output_mutex);
+    output += text;
+}
+
+std::string XenoBufferedIO::takeOutput() {
+    std::lock_guard<std::mutex> lk(output_mutex);
+    std::string result;
+    result.swap(output);
+    return result;
+}
+
+int XenoBufferedIO::available() {
+    std::lock_guard<std::mutex> lk(input_mutex);
+    if (input_queue.empty()) return 0;
+    return static_cast<int>(input_queue.front().size());
+}
+
+bool XenoBufferedIO::hasInput() {
+    std::lock_guard<std::mutex> lk(input_mutex);
+    return !input_queue.empty();
+}
+
+bool XenoBufferedIO::readLine(std::string& line, unsigned long timeout_ms) {
+    std::unique_lock<std::mutex> lk(input_mutex);
+    auto ready = [this] { return input_closed || !input_queue.empty(); };
+    if (timeout_ms == 0) {
+        input_cv.wait(lk, ready);
+    } else if (!input_cv.wait_for(lk, std::chrono::milliseconds(timeout_ms), ready)) {
+        return false;
+    }
+    if (input_queue.empty()) return false;
+    line = std::move(input_queue.front());
+    input_queue.pop_front();
+    return true;
+}
+
+bool XenoBufferedIO::tryReadLine(std::string& line) {
+    std::lock_guard<std::mutex> lk(input_mutex);
+    if (input_queue.empty()) return false;
+    line = std::move(input_queue.front());
+    input_queue.pop_front();
+    return true;
+}
+
+void XenoBufferedIO::pushInput(const std::string& line) {
+    std::lock_guard<std::mutex> lk(input_mutex);
+    std::string copy = line;
+    while (!copy.empty() && (copy.back() == '\r' || copy.back() == '\n')) copy.pop_back();
+    input_queue.push_back(copy);
+    input_cv.notify_one();
+}
+
+void XenoBufferedIO::closeInput() {
+    std::lock_guard<std::mutex> lk(input_mutex);
+    input_closed = true;
+    input_cv.notify_all();
+}
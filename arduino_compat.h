@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <chrono>
 #include <thread>
@@ -16,6 +17,7 @@
 #include <iomanip>
 #include <limits>
 #include <cstdint>
+#include <charconv>
 #include <mutex>
 #include <condition_variable>
 #include <deque>
@@ -58,15 +60,107 @@ inline void SerialPushInput(const std::string& s) {
     g_serialCv.notify_one();
 }
 
+// I/O backend behind Serial, delay/millis and the GPIO functions.
+// The base class is the default adapter: it writes through g_outputCallback
+// (or stdout), reads from the global serial queue and uses the real clock.
+// An engine can bind its own context to the calling thread with XenoIOScope
+// so that several engines in one process do not share input or output.
+class XenoIOContext {
+public:
+    virtual ~XenoIOContext() = default;
+
+    // Output sink
+    virtual void write(const std::string& text);
+
+    // Input source; readLine returns false on timeout (timeout 0 waits forever)
+    virtual int available();
+    virtual bool readLine(std::string& line, unsigned long timeout_ms);
+    virtual bool tryReadLine(std::string& line);
+    virtual void pushInput(const std::string& line);
+
+    // Clock
+    virtual void sleepMs(unsigned long ms);
+    virtual unsigned long millis();
+
+    // Pin backend
+    virtual void pinMode(uint8_t, uint8_t) {}
+    virtual void digitalWrite(uint8_t, uint8_t) {}
+    virtual int digitalRead(uint8_t) { return 0; }
+
+    static XenoIOContext& getDefault();
+    static XenoIOContext& current();
+
+private:
+    friend class XenoIOScope;
+    static thread_local XenoIOContext* bound_context;
+};
+
+// Binds an I/O context to the current thread for the lifetime of the scope
+class XenoIOScope {
+public:
+    explicit XenoIOScope(XenoIOContext& context) : previous(XenoIOContext::bound_context) {
+        XenoIOContext::bound_context = &context;
+    }
+    ~XenoIOScope() { XenoIOContext::bound_context = previous; }
+    XenoIOScope(const XenoIOScope&) = delete;
+    XenoIOScope& operator=(const XenoIOScope&) = delete;
+
+private:
+    XenoIOContext* previous;
+};
+
+// Isolated I/O context with a private input queue. Output goes to the
+// given sink, or is captured and can be collected with takeOutput().
+class XenoBufferedIO : public XenoIOContext {
+public:
+    explicit XenoBufferedIO(std::function<void(const std::string&)> sink = nullptr)
+        : output_sink(std::move(sink)) {}
+
+    void write(const std::string& text) override;
+    int available() override;
+    bool readLine(std::string& line, unsigned long timeout_ms) override;
+    bool tryReadLine(std::string& line) override;
+    void pushInput(const std::string& line) override;
+    // Whether a line is queued, even an empty one available() reports as 0
+    bool hasInput();
+
+    // After closeInput() reads fail immediately once the queue is drained
+    void closeInput();
+    std::string takeOutput();
+
+private:
+    std::function<void(const std::string&)> output_sink;
+    std::string output;
+    std::mutex output_mutex;
+
+    std::deque<std::string> input_queue;
+    std::mutex input_mutex;
+    std::condition_variable input_cv;
+    bool input_closed = false;
+};
+
 
 class XenoString {
 private:
     std::string str;
 
+    // Parses a leading number like std::stoi/std::stof, returning 0 instead of throwing
+    template<typename T>
+    T parseNumber() const {
+        const char* first = str.c_str();
+        const char* last = first + str.length();
+        while (first < last && std::isspace(static_cast<unsigned char>(*first))) ++first;
+        if (first < last && *first == '+') ++first;
+        T value = 0;
+        std::from_chars_result result = std::from_chars(first, last, value);
+        return result.ec == std::errc() ? value : T(0);
+    }
+
 public:
     XenoString() : str("") {}
     XenoString(const char* s) : str(s ? s : "") {}
     XenoString(const std::string& s) : str(s) {}
+    explicit XenoString(std::string_view s) : str(s) {}
     XenoString(char c) : str(1, c) {}
     XenoString(int value) : str(std::to_string(value)) {}
     XenoString(unsigned int value) : str(std::to_string(value)) {}
@@ -93,6 +187,7 @@ public:
     // Conversion operators
     operator std::string() const { return str; }
     const char* c_str() const { return str.c_str(); }
+    std::string_view view() const { return str; }
     std::string toString() const { return str; }
 
     // Capacity
@@ -294,41 +389,10 @@ public:
     }
 
     // Conversion
-    int toInt() const {
-        try {
-            return std::stoi(str);
-        }
-        catch (...) {
-            return 0;
-        }
-    }
-
-    long toLong() const {
-        try {
-            return std::stol(str);
-        }
-        catch (...) {
-            return 0;
-        }
-    }
-
-    float toFloat() const {
-        try {
-            return std::stof(str);
-        }
-        catch (...) {
-            return 0.0f;
-        }
-    }
-
-    double toDouble() const {
-        try {
-            return std::stod(str);
-        }
-        catch (...) {
-            return 0.0;
-        }
-    }
+    int toInt() const { return parseNumber<int>(); }
+    long toLong() const { return parseNumber<long>(); }
+    float toFloat() const { return parseNumber<float>(); }
+    double toDouble() const { return parseNumber<double>(); }
 
     bool toBoolean() const {
         if (equalsIgnoreCase("true") || equals("1")) return true;
@@ -474,34 +538,19 @@ public:
     void end() {}
 
     int available() {
-        std::lock_guard<std::mutex> lk(g_serialMutex);
-        if (g_serialQueue.empty()) return 0;
-        return static_cast<int>(g_serialQueue.front().size());
+        return XenoIOContext::current().available();
     }
 
     XenoString readString() {
-        std::lock_guard<std::mutex> lk(g_serialMutex);
-        if (g_serialQueue.empty()) return XenoString("");
-        std::string s = std::move(g_serialQueue.front());
-        g_serialQueue.pop_front();
+        std::string s;
+        if (!XenoIOContext::current().tryReadLine(s)) return XenoString("");
         return XenoString(s);
     }
 
-    // Blocking read with timeout - if you added it earlier, оставьте её
+    // Blocking read with timeout (0 waits forever); returns "" on timeout
     XenoString readStringTimeout(unsigned long timeout_ms) {
-        std::unique_lock<std::mutex> lk(g_serialMutex);
-        if (g_serialQueue.empty()) {
-            if (timeout_ms == 0) {
-                g_serialCv.wait(lk, [] { return !g_serialQueue.empty(); });
-            } else {
-                auto dur = std::chrono::milliseconds(timeout_ms);
-                if (!g_serialCv.wait_for(lk, dur, [] { return !g_serialQueue.empty(); })) {
-                    return XenoString("");
-                }
-            }
-        }
-        std::string s = std::move(g_serialQueue.front());
-        g_serialQueue.pop_front();
+        std::string s;
+        if (!XenoIOContext::current().readLine(s, timeout_ms)) return XenoString("");
         return XenoString(s);
     }
 
@@ -511,36 +560,20 @@ public:
         std::stringstream ss;
         ss << value;
         std::string output = ss.str();
-
-        // Use global callback if set, otherwise fall back to cout.
-        if (g_outputCallback) {
-            g_outputCallback(output);
-        } else {
-            std::cout << output;
-            std::cout.flush(); // <- важное: сразу сбрасываем буфер stdout
-        }
+        XenoIOContext::current().write(output);
         return output.length();
     }
 
     template<typename T>
     size_t println(const T& value) {
         size_t result = print(value);
-        // ensuring newline and flush
-        if (g_outputCallback) {
-            g_outputCallback("\n");
-        } else {
-            std::cout << std::endl; // std::endl вставит '\n' и flush
-        }
+        XenoIOContext::current().write("\n");
         return result + 1;
     }
 
     // println() без аргументов
     size_t println() {
-        if (g_outputCallback) {
-            g_outputCallback("\n");
-        } else {
-            std::cout << std::endl;
-        }
+        XenoIOContext::current().write("\n");
         return 1;
     }
     // Явные специализации для устранения неоднозначности
@@ -572,15 +605,15 @@ extern SerialClass Serial;
 
 // Inline функции
 inline void pinMode(uint8_t pin, uint8_t mode) {
-    // Implementation for Windows
+    XenoIOContext::current().pinMode(pin, mode);
 }
 
 inline void digitalWrite(uint8_t pin, uint8_t val) {
-    // Implementation for Windows  
+    XenoIOContext::current().digitalWrite(pin, val);
 }
 
 inline int digitalRead(uint8_t pin) {
-    return 0;
+    return XenoIOContext::current().digitalRead(pin);
 }
 
 inline int analogRead(uint8_t pin) {
@@ -594,7 +627,7 @@ inline void analogWrite(uint8_t pin, int val) {
 }
 
 inline void delay(unsigned long ms) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    XenoIOContext::current().sleepMs(ms);
 }
 
 inline void delayMicroseconds(unsigned int us) {
@@ -602,9 +635,7 @@ inline void delayMicroseconds(unsigned int us) {
 }
 
 inline unsigned long millis() {
-    auto now = std::chrono::steady_clock::now();
-    auto duration = now.time_since_epoch();
-    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    return XenoIOContext::current().millis();
 }
 
 inline unsigned long micros() {
@@ -205,41 +205,29 @@ def replace_handleINPUT(content):
     removal_start = line_start + 1 if line_start != -1 else abs_start
 
     replacement = '''void XenoVM::handleINPUT(const XenoInstruction& instr) {
-    if (instr.arg1 >= string_table.size()) {
+    if (instr.arg1 >= string_table->size()) {
         Serial.println("ERROR: Invalid variable name index in INPUT");
         running = false;
         return;
     }
-    String var_name = string_table[instr.arg1];
+    String var_name = (*string_table)[instr.arg1];
     Serial.print("INPUT ");
     Serial.print(var_name);
     Serial.println(":");
     const unsigned long TIMEOUT_MS = 30000;
-    XenoString raw = Serial.readStringTimeout(TIMEOUT_MS);
-    String input_str = raw;
-    input_str.trim();
 
-    if (input_str.isEmpty()) {
-        Serial.println("TIMEOUT - using default value 0");
-        variables[var_name] = XenoValue::makeInt(0);
+    if (cooperative) {
+        input_pending = true;
+        pending_input_index = instr.arg1;
+        input_deadline = io.millis() + TIMEOUT_MS;
+        if (!completePendingInput()) {
+            wake_time = input_deadline;
+            yield_reason = YIELD_INPUT;
+        }
         return;
     }
-    XenoString temp = input_str;
-    temp.trim();
-    XenoString lowered = temp.toLower();
-    XenoValue input_value;
-    if (isInteger(temp)) {
-        input_value = XenoValue::makeInt(temp.toInt());
-    } else if (isFloat(temp)) {
-        input_value = XenoValue::makeFloat(temp.toFloat());
-    } else if (lowered == "true" || lowered == "false") {
-        input_value = XenoValue::makeBool(lowered == "true");
-    } else {
-        input_value = XenoValue::makeString(addString(temp));
-    }
-    variables[var_name] = input_value;
-    Serial.print("-> ");
-    Serial.println(input_str);
+
+    storeInput(var_name, Serial.readStringTimeout(TIMEOUT_MS));
 }'''
 
     new_content = content[:removal_start] + replacement + content[end_pos+1:]
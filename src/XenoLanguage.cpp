@@ -15,37 +15,546 @@
  */
 
 #include <vector>
+#include <utility>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+#include <filesystem>
 #include "XenoLanguage.h"
+#include "xeno/runtime/xeno_thread_pool.h"
+#include "xeno/runtime/xeno_bytecode_file.h"
+#include "xeno/runtime/xeno_binary_io.h"
+#include "xeno/runtime/xeno_mapped_file.h"
 #define String XenoString
 
 XenoLanguage::XenoLanguage() {
     recreateObjects();
 }
 
+XenoLanguage::XenoLanguage(XenoIOContext& io) : io_context(&io) {
+    recreateObjects();
+}
+
+XenoLanguage::~XenoLanguage() {
+    checkpoint_writer.reset();
+    delete compiler;
+    delete vm;
+}
+
 void XenoLanguage::recreateObjects() {
     if (compiler) delete compiler;
     if (vm) delete vm;
     compiler = new XenoCompiler(security_config);
-    vm = new XenoVM(security_config);
+    compiler->setLineCache(&line_cache);
+    compiler->setOptimizationLevel(optimization_level);
+    compiler->setModuleResolver([this](std::string_view name, int line_number) {
+        return loadModule(name, line_number);
+    });
+    vm = new XenoVM(security_config, *io_context);
+    verified_fingerprint.clear();
+    installCheckpointHandler();
+}
+
+void XenoLanguage::loadCompiledProgram(bool less_output) {
+    bool verified = !verified_fingerprint.empty() && verified_fingerprint == configFingerprint();
+    vm->loadProgram(compiler->getBytecode(), compiler->getStringTable(), less_output, verified,
+                    &compiler->getStringIndex());
+}
+
+std::string XenoLanguage::configFingerprint() const {
+    // Everything that affects compilation or verification; the instruction
+    // limit only matters at run time
+    XenoByteWriter out;
+    out.writeU16(XenoCompiler::CODEGEN_REVISION);
+    out.writeU8(optimization_level);
+    out.writeU16(security_config.getMaxStringLength());
+    out.writeU16(security_config.getMaxVariableNameLength());
+    out.writeU16(security_config.getMaxExpressionDepth());
+    out.writeU16(security_config.getMaxLoopDepth());
+    out.writeU16(security_config.getMaxIfDepth());
+    out.writeU16(security_config.getMaxStackSize());
+    const std::vector<uint8_t>& pins = security_config.getAllowedPins();
+    out.writeU32(pins.size());
+    out.writeBytes(pins.data(), pins.size());
+    return out.take();
+}
+
+bool XenoLanguage::verifySilently(const std::vector<XenoInstruction>& bytecode,
+                                  const std::vector<String>& strings) {
+    // Failures are reported again when the VM loads the program
+    XenoBufferedIO discard;
+    XenoIOScope quiet(discard);
+    XenoSecurity security(security_config);
+
+    std::vector<String> sanitized_strings;
+    sanitized_strings.reserve(strings.size());
+    for (const String& str : strings) {
+        sanitized_strings.push_back(security.sanitizeString(str));
+    }
+    return security.verifyBytecode(bytecode, sanitized_strings);
+}
+
+void XenoLanguage::installCheckpointHandler() {
+    vm->setSnapshotHandler([this](std::shared_ptr<const XenoVMSnapshot> snapshot) {
+        std::lock_guard<std::mutex> lk(checkpoint_mutex);
+        if (checkpoint_writer && !checkpoint_path.empty()) {
+            checkpoint_writer->submit(checkpoint_path, std::move(snapshot));
+        }
+    });
+    vm->setSnapshotInterval(checkpoint_interval);
+}
+
+void XenoLanguage::setIOContext(XenoIOContext& io) {
+    io_context = &io;
+    recreateObjects();
 }
 
+void XenoLanguage::resetLineCacheIfStale(const std::string& fingerprint) {
+    if (fingerprint != line_cache_fingerprint) {
+        line_cache.clear();
+        line_cache_fingerprint = fingerprint;
+    }
+}
+
+void XenoLanguage::setCompileThreads(size_t threads) {
+    if (threads == 0) threads = XenoThreadPool::defaultThreadCount();
+    if (threads <= 1) {
+        compile_pool.reset();
+    } else if (!compile_pool || compile_pool->size() != threads) {
+        compile_pool = std::make_unique<XenoThreadPool>(threads);
+    }
+}
+
+bool XenoLanguage::setOptimizationLevel(uint8_t level) {
+    if (level > XenoOptimizer::MAX_LEVEL) return false;
+    optimization_level = level;
+    return true;
+}
+
+void XenoLanguage::compileSource(const String& source_code) {
+    if (compile_pool) {
+        compiler->compileParallel(source_code, *compile_pool);
+    } else {
+        compiler->compile(source_code);
+    }
+}
 
 bool XenoLanguage::compile(const String& source_code) {
+    XenoIOScope io_scope(*io_context);
     recreateObjects();
-    compiler->compile(source_code);
+    std::string fingerprint = configFingerprint();
+    resetLineCacheIfStale(fingerprint);
+    if (!compile_cache) {
+        compileSource(source_code);
+        return true;
+    }
+
+    XenoCompileCache::Key key = XenoCompileCache::makeKey(
+        std::string(source_code.c_str(), source_code.length()), fingerprint);
+    std::shared_ptr<const XenoCompileCache::Entry> cached = compile_cache->lookup(key,
+        [this](const XenoCompileCache::Entry& entry) {
+            return verifySilently(entry.bytecode, entry.strings);
+        });
+    if (cached) {
+        if (!cached->diagnostics.empty()) io_context->write(cached->diagnostics);
+        compiler->setProgram(cached->bytecode, cached->strings, cached->optimizer_stats);
+        verified_fingerprint = fingerprint;
+        return true;
+    }
+
+    std::shared_ptr<XenoCompileCache::Entry> entry = std::make_shared<XenoCompileCache::Entry>();
+    {
+        // Record compiler messages for later hits while still showing them
+        XenoBufferedIO recorder([this, &entry](const std::string& text) {
+            entry->diagnostics += text;
+            io_context->write(text);
+        });
+        XenoIOScope record_scope(recorder);
+        compileSource(source_code);
+    }
+    // A program with imports also depends on the module files
+    if (!compiler->hasImports() && verifySilently(compiler->getBytecode(), compiler->getStringTable())) {
+        entry->bytecode = compiler->getBytecode();
+        entry->strings = compiler->getStringTable();
+        entry->optimizer_stats = compiler->getOptimizerStats();
+        compile_cache->store(key, entry);
+        verified_fingerprint = fingerprint;
+    }
     return true;
 }
 
+bool XenoLanguage::compile(XenoSourceStream& source) {
+    size_t size = source.sizeHint();
+    if (size <= STREAM_THRESHOLD) {
+        std::string text;
+        text.reserve(size);
+        for (std::string_view chunk = source.next(); !chunk.empty(); chunk = source.next()) {
+            text.append(chunk);
+        }
+        if (source.failed()) return false;
+        return compile(String(text));
+    }
+
+    XenoIOScope io_scope(*io_context);
+    recreateObjects();
+    // Cached fragments are keyed by their line, which would keep a copy of
+    // the whole source alive
+    line_cache.clear();
+    compiler->setLineCache(nullptr);
+
+    compiler->beginCompile();
+    for (std::string_view chunk = source.next(); !chunk.empty(); chunk = source.next()) {
+        compiler->compileChunk(chunk);
+    }
+    compiler->finishCompile();
+    return !source.failed();
+}
+
+bool XenoLanguage::compileFile(const std::string& path, XenoSourceFileStats* stats) {
+    XenoIOScope io_scope(*io_context);
+    recreateObjects();
+    resetLineCacheIfStale(configFingerprint());
+
+    XenoSourceFileStats read_stats;
+    std::vector<std::string> included;
+    compiler->beginCompile();
+    bool ok = compileSourceFile(path, included, 0, read_stats);
+    compiler->finishCompile();
+    if (stats) *stats = read_stats;
+    return ok;
+}
+
+bool XenoLanguage::compileSourceFile(const std::string& path, std::vector<std::string>& included,
+                                     int depth, XenoSourceFileStats& stats) {
+    std::error_code error;
+    std::string identity = std::filesystem::weakly_canonical(path, error).string();
+    if (error) identity = path;
+    if (std::find(included.begin(), included.end(), identity) != included.end()) {
+        return true;
+    }
+    included.push_back(identity);
+
+    XenoMappedFile file;
+    if (!file.open(path)) {
+        Serial.print("ERROR: Cannot read source file ");
+        Serial.println(path.c_str());
+        return false;
+    }
+    std::string_view text(reinterpret_cast<const char*>(file.data()), file.size());
+    ++stats.files;
+    stats.bytes += text.size();
+
+    // Prefix every message line with the file it comes from
+    XenoIOContext& target = *io_context;
+    std::string prefix = path + ": ";
+    bool line_start = true;
+    XenoBufferedIO labeled([&](const std::string& message) {
+        std::string out;
+        for (char c : message) {
+            if (line_start) out += prefix;
+            out += c;
+            line_start = c == '\n';
+        }
+        target.write(out);
+    });
+    XenoIOScope label_scope(labeled);
+    // Imports are relative to the file they appear in
+    std::string saved_base = module_base_dir;
+    module_base_dir = std::filesystem::path(path).parent_path().string();
+
+    bool ok = true;
+    XenoLexer lexer(text);
+    std::string_view line;
+    while (lexer.nextLine(line)) {
+        ++stats.lines;
+        std::string_view statement = XenoLexer::statement(line);
+        if (statement.rfind("#include", 0) != 0) {
+            if (!line.empty()) compiler->compileLine(line, lexer.lineNumber());
+            continue;
+        }
+
+        std::string_view name = XenoLexer::trim(statement.substr(8));
+        if (name.length() < 3 || name.front() != '"' || name.back() != '"') {
+            Serial.print("ERROR: Invalid #include at line ");
+            Serial.println(lexer.lineNumber());
+            ok = false;
+        } else if (depth + 1 >= MAX_INCLUDE_DEPTH) {
+            Serial.print("ERROR: Includes nested too deep at line ");
+            Serial.println(lexer.lineNumber());
+            ok = false;
+        } else {
+            std::filesystem::path include_path = std::filesystem::path(path).parent_path() /
+                std::string(name.substr(1, name.length() - 2));
+            ok = compileSourceFile(include_path.string(), included, depth + 1, stats) && ok;
+        }
+    }
+    module_base_dir = saved_base;
+    return ok;
+}
+
+bool XenoLanguage::moduleKey(const std::string& path, XenoCompileCache::Key& key) const {
+    XenoMappedFile file;
+    if (!file.open(path)) return false;
+    std::string source(reinterpret_cast<const char*>(file.data()), file.size());
+    key = XenoCompileCache::makeKey(source, configFingerprint() + "module");
+    return true;
+}
+
+std::shared_ptr<const XenoModule> XenoLanguage::loadModule(std::string_view name, int line_number) {
+    std::filesystem::path path = std::filesystem::path(module_base_dir) / std::string(name);
+    std::error_code error;
+    std::string identity = std::filesystem::weakly_canonical(path, error).string();
+    if (error) identity = path.string();
+
+    if (std::find(module_stack.begin(), module_stack.end(), identity) != module_stack.end()) {
+        Serial.print("ERROR: Circular import of ");
+        Serial.print(path.string().c_str());
+        Serial.print(" at line ");
+        Serial.println(line_number);
+        return nullptr;
+    }
+
+    auto cached = module_cache.find(identity);
+    if (cached != module_cache.end()) {
+        bool current = true;
+        for (const auto& file : cached->second.files) {
+            XenoCompileCache::Key key;
+            current = current && moduleKey(file.first, key) && key == file.second;
+        }
+        if (current) return cached->second.module;
+        module_cache.erase(cached);
+    }
+
+    XenoMappedFile file;
+    if (!file.open(path.string())) {
+        Serial.print("ERROR: Cannot read module ");
+        Serial.print(path.string().c_str());
+        Serial.print(" at line ");
+        Serial.println(line_number);
+        return nullptr;
+    }
+    std::string source(reinterpret_cast<const char*>(file.data()), file.size());
+    file.close();
+
+    std::shared_ptr<XenoModule> module = std::make_shared<XenoModule>();
+    module->name = identity;
+    std::string saved_base = module_base_dir;
+    module_base_dir = path.parent_path().string();
+    module_stack.push_back(identity);
+    bool complete;
+    {
+        // Messages are kept, labeled with the module, and shown whenever it is linked
+        std::string prefix = path.string() + ": ";
+        bool line_start = true;
+        XenoBufferedIO recorder([&](const std::string& message) {
+            for (char c : message) {
+                if (line_start) module->diagnostics += prefix;
+                module->diagnostics += c;
+                line_start = c == '\n';
+            }
+        });
+        XenoIOScope record_scope(recorder);
+        XenoCompiler module_compiler(security_config);
+        module_compiler.setModuleResolver([this](std::string_view nested, int nested_line) {
+            return loadModule(nested, nested_line);
+        });
+        complete = module_compiler.compileModule(String(source), *module);
+    }
+    module_stack.pop_back();
+    module_base_dir = saved_base;
+
+    if (!complete) {
+        XenoIOContext::current().write(module->diagnostics);
+        Serial.print("ERROR: Module ");
+        Serial.print(path.string().c_str());
+        Serial.print(" leaves an IF or FOR block open at line ");
+        Serial.println(line_number);
+        return nullptr;
+    }
+
+    CachedModule& entry = module_cache[identity];
+    entry.module = module;
+    entry.files.emplace_back(identity, XenoCompileCache::makeKey(source, configFingerprint() + "module"));
+    for (const std::string& contained : module->contained) {
+        auto dependency = module_cache.find(contained);
+        if (dependency != module_cache.end()) {
+            entry.files.insert(entry.files.end(), dependency->second.files.begin(),
+                               dependency->second.files.end());
+        }
+    }
+    return module;
+}
+
 bool XenoLanguage::run(bool less_output) {
-    vm->loadProgram(compiler->getBytecode(), compiler->getStringTable(), less_output);
+    XenoIOScope io_scope(*io_context);
+    loadCompiledProgram(less_output);
     vm->run(less_output);
     return true;
 }
 
 bool XenoLanguage::compile_and_run(const String& source_code, bool less_output) {
+    XenoIOScope io_scope(*io_context);
+    compile(source_code);
+    loadCompiledProgram(less_output);
+    vm->run(less_output);
+    return true;
+}
+
+bool XenoLanguage::saveBytecode(const std::string& path) const {
+    XenoIOScope io_scope(*io_context);
+    if (compiler->getBytecode().empty()) {
+        Serial.println("ERROR: No compiled program to save");
+        return false;
+    }
+    if (!XenoBytecodeFile::save(path, compiler->getBytecode(), compiler->getStringTable())) {
+        Serial.print("ERROR: Cannot write bytecode file ");
+        Serial.println(path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool XenoLanguage::loadBytecode(const std::string& path) {
+    XenoIOScope io_scope(*io_context);
+    std::vector<XenoInstruction> bytecode;
+    std::vector<String> strings;
+    if (!XenoBytecodeFile::load(path, bytecode, strings)) return false;
+
+    XenoSecurity security(security_config);
+    if (!security.verifyBytecode(bytecode, strings)) {
+        Serial.println("SECURITY: Bytecode verification failed - refusing to load");
+        return false;
+    }
+
     recreateObjects();
-    compiler->compile(source_code);
-    vm->loadProgram(compiler->getBytecode(), compiler->getStringTable(), less_output);
+    compiler->setProgram(std::move(bytecode), std::move(strings));
+    return true;
+}
+
+std::vector<XenoBatchResult> XenoLanguage::runBatch(const std::vector<XenoBatchJob>& jobs,
+                                                    size_t worker_count,
+                                                    XenoThreadPool::QueueMode queue_mode,
+                                                    bool pin_workers) const {
+    std::vector<XenoBatchResult> results(jobs.size());
+    if (jobs.empty()) return results;
+
+    if (worker_count == 0) worker_count = XenoThreadPool::defaultThreadCount();
+    XenoThreadPool pool(min(worker_count, jobs.size()), queue_mode, pin_workers);
+
+    auto batch_start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        pool.submit([this, &jobs, &results, i, batch_start]() {
+            const XenoBatchJob& job = jobs[i];
+            XenoBatchResult& result = results[i];
+
+            XenoBufferedIO io;
+            for (const std::string& line : job.input) {
+                io.pushInput(line);
+            }
+            io.closeInput();
+
+            auto start = std::chrono::steady_clock::now();
+            try {
+                XenoLanguage engine(io);
+                engine.copySecurityConfig(*this);
+                engine.setOptimizationLevel(optimization_level);
+                engine.setCompileCache(compile_cache);
+                engine.compile_and_run(job.source);
+                result.instruction_count = engine.vm->getInstructionCount();
+                result.output = io.takeOutput();
+            } catch (const std::exception& ex) {
+                result.output = io.takeOutput() + "Runtime error: " + ex.what() + "\n";
+            }
+            auto finish = std::chrono::steady_clock::now();
+            result.elapsed_ms = std::chrono::duration<double, std::milli>(finish - start).count();
+            result.latency_ms = std::chrono::duration<double, std::milli>(finish - batch_start).count();
+        });
+    }
+
+    pool.waitIdle();
+    return results;
+}
+
+bool XenoLanguage::start(bool less_output) {
+    XenoIOScope io_scope(*io_context);
+    loadCompiledProgram(less_output);
+    return vm->isRunning();
+}
+
+XenoYieldReason XenoLanguage::runSlice(uint32_t fuel) {
+    return vm->runSlice(fuel);
+}
+
+unsigned long XenoLanguage::getWakeTime() const {
+    return vm->getWakeTime();
+}
+
+std::shared_ptr<const XenoVMSnapshot> XenoLanguage::snapshotAt(uint32_t pc, bool less_output) {
+    XenoIOScope io_scope(*io_context);
+    loadCompiledProgram(less_output);
+    if (!vm->runTo(pc)) {
+        Serial.println("ERROR: Program stopped before reaching the snapshot address");
+        return nullptr;
+    }
+    return vm->takeSnapshot();
+}
+
+bool XenoLanguage::runFromSnapshot(const XenoVMSnapshot& snapshot, bool less_output) {
+    XenoIOScope io_scope(*io_context);
+    if (!vm->restoreSnapshot(snapshot)) return false;
+    vm->run(less_output);
+    return true;
+}
+
+uint32_t XenoLanguage::findFirstInput() const {
+    const std::vector<XenoInstruction>& bytecode = compiler->getBytecode();
+    for (size_t i = 0; i < bytecode.size(); ++i) {
+        if (bytecode[i].opcode == OP_INPUT) return i;
+    }
+    return bytecode.size();
+}
+
+void XenoLanguage::requestCheckpoint(const std::string& path) {
+    {
+        std::lock_guard<std::mutex> lk(checkpoint_mutex);
+        checkpoint_path = path;
+        if (!checkpoint_writer) checkpoint_writer.reset(new XenoCheckpointWriter());
+    }
+    vm->requestSnapshot();
+}
+
+void XenoLanguage::setCheckpointInterval(uint32_t instructions, const std::string& path) {
+    {
+        std::lock_guard<std::mutex> lk(checkpoint_mutex);
+        checkpoint_path = path;
+        checkpoint_interval = instructions;
+        if (!checkpoint_writer) checkpoint_writer.reset(new XenoCheckpointWriter());
+    }
+    vm->setSnapshotInterval(instructions);
+}
+
+bool XenoLanguage::flushCheckpoints() {
+    XenoCheckpointWriter* writer;
+    {
+        std::lock_guard<std::mutex> lk(checkpoint_mutex);
+        writer = checkpoint_writer.get();
+    }
+    // The writer lives as long as the engine; waiting without the lock
+    // keeps the VM from stalling on its next snapshot
+    return writer ? writer->flush() : true;
+}
+
+bool XenoLanguage::resumeFromCheckpoint(const std::string& path, bool less_output) {
+    XenoIOScope io_scope(*io_context);
+    loadCompiledProgram(less_output);
+    if (!vm->isRunning()) return false;
+
+    XenoVMSnapshot restored;
+    if (!XenoCheckpoint::loadFile(path, *vm->takeSnapshot(), restored) ||
+        !vm->restoreSnapshot(restored)) {
+        vm->stop();
+        return false;
+    }
     vm->run(less_output);
     return true;
 }
@@ -62,15 +571,22 @@ bool XenoLanguage::isRunning() const {
     return vm->isRunning();
 }
 
+uint32_t XenoLanguage::getInstructionCount() const {
+    return vm->getInstructionCount();
+}
+
 void XenoLanguage::dumpState() {
+    XenoIOScope io_scope(*io_context);
     vm->dumpState();
 }
 
 void XenoLanguage::disassemble() {
+    XenoIOScope io_scope(*io_context);
     vm->disassemble();
 }
 
 void XenoLanguage::printCompiledCode() {
+    XenoIOScope io_scope(*io_context);
     compiler->printCompiledCode();
 }
 
@@ -82,6 +598,10 @@ const XenoSecurityConfig& XenoLanguage::getSecurityConfig() const {
     return security_config;
 }
 
+void XenoLanguage::copySecurityConfig(const XenoLanguage& other) {
+    security_config = other.security_config;
+}
+
 bool XenoLanguage::setStringLimit(uint16_t length) {
     return security_config.setMaxStringLength(length);
 }
@@ -18,13 +18,43 @@
 #define SRC_XENOLANGUAGE_H_
 
 #include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
 #include "xeno/main/xeno_compiler.h"
 #include "xeno/main/xeno_vm.h"
 #include "xeno/security/xeno_security_config.h"
+#include "xeno/runtime/xeno_thread_pool.h"
+#include "xeno/runtime/xeno_checkpoint.h"
+#include "xeno/runtime/xeno_compile_cache.h"
+#include "xeno/runtime/xeno_source_stream.h"
 #include "arduino_compat.h"
 #define String XenoString
 
 
+// One program of a batch: source code plus the lines fed to INPUT
+struct XenoBatchJob {
+    std::string source;
+    std::vector<std::string> input;
+};
+
+struct XenoBatchResult {
+    std::string output;
+    uint32_t instruction_count = 0;
+    double elapsed_ms = 0.0;
+    // From batch submission until the job finished, including queueing
+    double latency_ms = 0.0;
+};
+
+// What compileFile() read
+struct XenoSourceFileStats {
+    size_t files = 0;
+    size_t bytes = 0;
+    size_t lines = 0;
+};
+
 class XenoLanguage {
  private:
     static constexpr const char* xeno_language_version = "v0.1.4";
@@ -32,29 +62,160 @@ class XenoLanguage {
     static constexpr const char* xeno_language_name = "Xeno Language";
 
     XenoSecurityConfig security_config;
+    XenoIOContext* io_context = &XenoIOContext::getDefault();
 
     XenoCompiler* compiler = new XenoCompiler(security_config);
-    XenoVM* vm = new XenoVM(security_config);
+    XenoVM* vm = new XenoVM(security_config, *io_context);
+
+    std::mutex checkpoint_mutex;
+    std::string checkpoint_path;
+    uint32_t checkpoint_interval = 0;
+    std::unique_ptr<XenoCheckpointWriter> checkpoint_writer;
+
+    XenoCompileCache* compile_cache = nullptr;
+    // Workers for parallel compiles; null compiles on the calling thread
+    std::unique_ptr<XenoThreadPool> compile_pool;
+    uint8_t optimization_level = XenoOptimizer::DEFAULT_LEVEL;
+    // Fragments of the last compiled source; cleared when the limits change
+    XenoLineCache line_cache;
+    std::string line_cache_fingerprint;
+    // Compiled modules by canonical path, with the content keys of every file
+    // they were built from; reused while none of those files changed
+    struct CachedModule {
+        std::shared_ptr<const XenoModule> module;
+        std::vector<std::pair<std::string, XenoCompileCache::Key>> files;
+    };
+    std::unordered_map<std::string, CachedModule> module_cache;
+    // Import paths are relative to this directory; modules being compiled
+    std::string module_base_dir;
+    std::vector<std::string> module_stack;
+    // Security limits the compiled program was verified under; empty if unverified
+    std::string verified_fingerprint;
+
+    static constexpr int MAX_INCLUDE_DEPTH = 16;
 
     void recreateObjects();
+    void resetLineCacheIfStale(const std::string& fingerprint);
+    void compileSource(const String& source_code);
+    std::shared_ptr<const XenoModule> loadModule(std::string_view name, int line_number);
+    bool moduleKey(const std::string& path, XenoCompileCache::Key& key) const;
+    bool compileSourceFile(const std::string& path, std::vector<std::string>& included,
+                           int depth, XenoSourceFileStats& stats);
+    void loadCompiledProgram(bool less_output);
+    std::string configFingerprint() const;
+    bool verifySilently(const std::vector<XenoInstruction>& bytecode, const std::vector<String>& strings);
+    void installCheckpointHandler();
 
  public:
     XenoLanguage();
+    explicit XenoLanguage(XenoIOContext& io);
+    ~XenoLanguage();
+    XenoLanguage(const XenoLanguage&) = delete;
+    XenoLanguage& operator=(const XenoLanguage&) = delete;
+
+    // I/O context used for program output, INPUT, delays and pins.
+    // The context is not owned and must outlive the engine.
+    void setIOContext(XenoIOContext& io);
+    XenoIOContext& getIOContext() const { return *io_context; }
+
+    // With a cache, compile() reuses programs compiled from the same source
+    // under the same security limits. The cache is not owned; nullptr disables.
+    void setCompileCache(XenoCompileCache* cache) { compile_cache = cache; }
+    XenoCompileCache* getCompileCache() const { return compile_cache; }
+
+    // compile() spreads large sources over this many threads (0 = hardware
+    // threads, 1 = compile serially). The program is the same either way.
+    void setCompileThreads(size_t threads);
+    size_t getCompileThreads() const { return compile_pool ? compile_pool->size() : 1; }
+
+    // 0: programs compile as written. 1: constant folding and propagation,
+    // identities, constant branches and jump chains, unreachable code,
+    // int/float opcodes, DUP reuse, STORE_KEEP/SWAP. 2: also hoists loop
+    // invariants into hidden variables. False if level is too high.
+    bool setOptimizationLevel(uint8_t level);
+    uint8_t getOptimizationLevel() const { return optimization_level; }
+    static constexpr uint8_t getMaxOptimizationLevel() { return XenoOptimizer::MAX_LEVEL; }
+    // What the optimizer did in the last compile; zero if the program came from a cache
+    const XenoOptimizer::Stats& getOptimizerStats() const { return compiler->getOptimizerStats(); }
+
+    // import "lib.xeno" links a module compiled on its own. Paths are relative
+    // to the importing file, or to the working directory for compile().
+    // Modules stay compiled until their files or the limits change.
+    size_t getModuleCacheSize() const { return module_cache.size(); }
+
+    // compile() only recompiles the lines that changed since the last compile
+    XenoLineCache::Stats getLineCacheStats() const { return line_cache.getStats(); }
 
     bool compile(const String& source_code);
+    // Sources of known size up to STREAM_THRESHOLD are read whole and use the
+    // compile and line caches. Larger ones, and those of unknown size, are
+    // compiled line by line as they are read and bypass both caches, so
+    // memory does not grow with the source. False if the source could not
+    // be read completely.
+    static constexpr size_t STREAM_THRESHOLD = 1024 * 1024;
+    bool compile(XenoSourceStream& source);
+    // Compiles a file and the files it pulls in with #include "name" (relative
+    // to the including file). Files are memory-mapped and lexed in place;
+    // each is included once. Messages are prefixed with the file they come
+    // from. False if a file could not be read.
+    bool compileFile(const std::string& path, XenoSourceFileStats* stats = nullptr);
     bool run(bool less_output = true);
     void step();
     void stop();
     bool isRunning() const;
+    uint32_t getInstructionCount() const;
     void dumpState();
     void disassemble();
     void printCompiledCode();
 
     bool compile_and_run(const String& source_code, bool less_output = true);
 
+    // Precompiled programs: saveBytecode() writes the last compiled program,
+    // loadBytecode() verifies a saved one and makes it the program run() executes.
+    bool saveBytecode(const std::string& path) const;
+    bool loadBytecode(const std::string& path);
+
+    // Cooperative execution: start() loads the compiled program and
+    // runSlice() executes at most fuel instructions, returning why it stopped.
+    // After YIELD_SLEEP or YIELD_INPUT, getWakeTime() is the millis() deadline.
+    bool start(bool less_output = true);
+    XenoYieldReason runSlice(uint32_t fuel);
+    unsigned long getWakeTime() const;
+
+    // Warm starts: snapshotAt() runs the compiled program until the next
+    // instruction is at pc and freezes it (nullptr if it stopped earlier).
+    // runFromSnapshot() continues a copy-on-write clone of it in this
+    // engine; one snapshot can seed any number of engines and threads.
+    std::shared_ptr<const XenoVMSnapshot> snapshotAt(uint32_t pc, bool less_output = true);
+    bool runFromSnapshot(const XenoVMSnapshot& snapshot, bool less_output = true);
+    // Address of the first INPUT instruction, or the program size if there is none
+    uint32_t findFirstInput() const;
+
+    // Checkpoints: the VM snapshots itself between instructions and a
+    // background writer saves the newest snapshot to path.
+    // requestCheckpoint() is safe while run() executes on another thread.
+    void requestCheckpoint(const std::string& path);
+    // Checkpoint every given number of instructions (0 disables); call
+    // while the program is not running
+    void setCheckpointInterval(uint32_t instructions, const std::string& path);
+    // Waits for pending checkpoint writes; false if the last one failed
+    bool flushCheckpoints();
+    // Loads the compiled program, restores the checkpoint made from it and runs on
+    bool resumeFromCheckpoint(const std::string& path, bool less_output = true);
+
+    // Compiles and runs every job in its own engine on a pool of worker_count
+    // threads (0 = hardware threads) using this engine's security limits
+    // and compile cache.
+    // Output is captured per job; results are returned in submission order.
+    std::vector<XenoBatchResult> runBatch(const std::vector<XenoBatchJob>& jobs,
+                                          size_t worker_count = 0,
+                                          XenoThreadPool::QueueMode queue_mode = XenoThreadPool::QUEUE_WORK_STEALING,
+                                          bool pin_workers = false) const;
+
     bool setMaxInstructions(uint32_t max_instr);
 
     const XenoSecurityConfig& getSecurityConfig() const;
+    void copySecurityConfig(const XenoLanguage& other);
 
     bool setStringLimit(uint16_t length);
     bool setVariableNameLimit(uint16_t length);
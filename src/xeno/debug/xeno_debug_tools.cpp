@@ -54,6 +54,8 @@ void Debugger::printInstruction(size_t index, const XenoInstruction& instr,
     switch (instr.opcode) {
         case OP_NOP: mnemonic = "NOP"; break;
         case OP_POP: mnemonic = "POP"; break;
+        case OP_DUP: mnemonic = "DUP"; break;
+        case OP_SWAP: mnemonic = "SWAP"; break;
         case OP_ADD: mnemonic = "ADD"; break;
         case OP_SUB: mnemonic = "SUB"; break;
         case OP_MUL: mnemonic = "MUL"; break;
@@ -74,6 +76,27 @@ void Debugger::printInstruction(size_t index, const XenoInstruction& instr,
         case OP_SIN: mnemonic = "SIN"; break;
         case OP_COS: mnemonic = "COS"; break;
         case OP_TAN: mnemonic = "TAN"; break;
+        case OP_ADD_INT: mnemonic = "ADD_INT"; break;
+        case OP_SUB_INT: mnemonic = "SUB_INT"; break;
+        case OP_MUL_INT: mnemonic = "MUL_INT"; break;
+        case OP_DIV_INT: mnemonic = "DIV_INT"; break;
+        case OP_MOD_INT: mnemonic = "MOD_INT"; break;
+        case OP_EQ_INT: mnemonic = "EQ_INT"; break;
+        case OP_NEQ_INT: mnemonic = "NEQ_INT"; break;
+        case OP_LT_INT: mnemonic = "LT_INT"; break;
+        case OP_GT_INT: mnemonic = "GT_INT"; break;
+        case OP_LTE_INT: mnemonic = "LTE_INT"; break;
+        case OP_GTE_INT: mnemonic = "GTE_INT"; break;
+        case OP_ADD_FLOAT: mnemonic = "ADD_FLOAT"; break;
+        case OP_SUB_FLOAT: mnemonic = "SUB_FLOAT"; break;
+        case OP_MUL_FLOAT: mnemonic = "MUL_FLOAT"; break;
+        case OP_DIV_FLOAT: mnemonic = "DIV_FLOAT"; break;
+        case OP_EQ_FLOAT: mnemonic = "EQ_FLOAT"; break;
+        case OP_NEQ_FLOAT: mnemonic = "NEQ_FLOAT"; break;
+        case OP_LT_FLOAT: mnemonic = "LT_FLOAT"; break;
+        case OP_GT_FLOAT: mnemonic = "GT_FLOAT"; break;
+        case OP_LTE_FLOAT: mnemonic = "LTE_FLOAT"; break;
+        case OP_GTE_FLOAT: mnemonic = "GTE_FLOAT"; break;
         case OP_HALT: mnemonic = "HALT"; break;
 
         case OP_PRINT:
@@ -140,6 +163,12 @@ void Debugger::printInstruction(size_t index, const XenoInstruction& instr,
             hasArg = true;
             break;
 
+        case OP_STORE_KEEP:
+            Serial.print("STORE_KEEP ");
+            printStringArg(instr.arg1, string_table, false);
+            hasArg = true;
+            break;
+
         case OP_LOAD:
             Serial.print("LOAD ");
             printStringArg(instr.arg1, string_table, false);
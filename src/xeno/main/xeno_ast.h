@@ -0,0 +1,66 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_MAIN_XENO_AST_H_
+#define SRC_XENO_MAIN_XENO_AST_H_
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "../xeno_common.h"
+
+
+// Expression tree node. Operands are indices into the owning arena, and
+// text views point into the source line being compiled.
+struct XenoExprNode {
+    enum Kind : uint8_t {
+        EXPR_NUMBER,
+        EXPR_BOOL,
+        EXPR_STRING,
+        EXPR_VARIABLE,
+        EXPR_NEGATE,
+        EXPR_BINARY,
+        EXPR_CALL
+    };
+
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    Kind kind = EXPR_NUMBER;
+    uint8_t opcode = OP_NOP;   // EXPR_BINARY and EXPR_CALL
+    uint32_t left = NONE;      // operand, or first argument of a call
+    uint32_t right = NONE;     // second operand or argument
+    XenoValue value;           // EXPR_NUMBER and EXPR_BOOL
+    std::string_view text;     // EXPR_STRING contents, EXPR_VARIABLE name
+};
+
+// All nodes of one expression in a single vector that is reused for the
+// next expression, so parsing does not allocate once it has warmed up.
+class XenoExprArena {
+ public:
+    uint32_t add(const XenoExprNode& node) {
+        nodes.push_back(node);
+        return static_cast<uint32_t>(nodes.size() - 1);
+    }
+    XenoExprNode& operator[](uint32_t index) { return nodes[index]; }
+    const XenoExprNode& operator[](uint32_t index) const { return nodes[index]; }
+    size_t size() const { return nodes.size(); }
+    void clear() { nodes.clear(); }
+
+ private:
+    std::vector<XenoExprNode> nodes;
+};
+
+#endif  // SRC_XENO_MAIN_XENO_AST_H_
@@ -17,124 +17,15 @@
 #include <stack>
 #include <algorithm>
 #include <vector>
+#include <utility>
 #include "xeno_compiler.h"
 #include "../debug/xeno_debug_tools.h"
+#include "../runtime/xeno_thread_pool.h"
 #define String XenoString
 
 
-const XenoCompiler::Constant XenoCompiler::constants[] = {
-    {"M_PI", "3.141592653589793"},
-    {"M_E", "2.718281828459045"},
-    {"M_TAU", "6.283185307179586"},
-    {"M_SQRT2", "1.4142135623730951"},
-    {"M_SQRT3", "1.7320508075688772"},
-    {"P_LIGHT_SPEED", "299792458"}
-};
-
-const size_t XenoCompiler::constants_count = std::size(constants);
-
-const XenoCompiler::FunctionInfo XenoCompiler::math_functions[] = {
-    {"abs(", '[', ']', OP_ABS, 1},
-    {"max(", '{', '}', OP_MAX, 2},
-    {"min(", '|', '|', OP_MIN, 2},
-    {"sqrt(", '~', '~', OP_SQRT, 1},
-    {"sin(", '#', '#', OP_SIN, 1},
-    {"cos(", '@', '@', OP_COS, 1},
-    {"tan(", '&', '&', OP_TAN, 1}
-};
-
-const size_t XenoCompiler::math_functions_count = sizeof(math_functions) / sizeof(math_functions[0]);
-
-const XenoCompiler::SimpleCommand XenoCompiler::simple_commands[] = {
-    {"pop", OP_POP},
-    {"add", OP_ADD},
-    {"sub", OP_SUB},
-    {"mul", OP_MUL},
-    {"div", OP_DIV},
-    {"mod", OP_MOD},
-    {"abs", OP_ABS},
-    {"pow", OP_POW},
-    {"max", OP_MAX},
-    {"min", OP_MIN},
-    {"sqrt", OP_SQRT},
-    {"printnum", OP_PRINT_NUM},
-    {"halt", OP_HALT}
-};
 
-const size_t XenoCompiler::simple_commands_count = sizeof(simple_commands) / sizeof(simple_commands[0]);
-
-void XenoCompiler::processConstants(String& expr) {
-    int pos = 0;
-    while (pos < expr.length()) {
-        if (expr[pos] == 'M' || expr[pos] == 'P') {
-            int start_pos = pos;
-            for (size_t i = 0; i < constants_count; i++) {
-                const char* name = constants[i].name;
-                size_t name_len = strlen(name);
-                if (pos + name_len <= expr.length()) {
-                    bool match = true;
-                    for (size_t j = 0; j < name_len; j++) {
-                        if (expr[pos + j] != name[j]) {
-                            match = false;
-                            break;
-                        }
-                    }
-                    if (match) {
-                        bool is_isolated = true;
-                        if (start_pos > 0) {
-                            char prev_char = expr[start_pos - 1];
-                            if (isalnum(prev_char) || prev_char == '_') {
-                                is_isolated = false;
-                            }
-                        }
-                        if (start_pos + name_len < expr.length()) {
-                            char next_char = expr[start_pos + name_len];
-                            if (isalnum(next_char) || next_char == '_') {
-                                is_isolated = false;
-                            }
-                        }
-                        if (is_isolated) {
-                            const char* value = constants[i].value;
-                            size_t value_len = strlen(value);
-                            expr = expr.substring(0, start_pos) +
-                                   value +
-                                   expr.substring(start_pos + name_len);
-                            pos = start_pos + value_len;
-                            break;
-                        }
-                    }
-                }
-            }
-        }
-        pos++;
-    }
-}
-
-void XenoCompiler::compileMathFunction(const String& token, const FunctionInfo& func) {
-    String innerExpr = token.substring(1, token.length() - 1);
-
-    if (func.num_args == 1) {
-        compileExpression(innerExpr);
-        emitInstruction(func.opcode);
-    } else if (func.num_args == 2) {
-        int commaPos = innerExpr.indexOf(',');
-        if (commaPos > 0) {
-            String arg1 = innerExpr.substring(0, commaPos);
-            String arg2 = innerExpr.substring(commaPos + 1);
-            compileExpression(arg1);
-            compileExpression(arg2);
-            emitInstruction(func.opcode);
-        } else {
-            Serial.println("ERROR: Function requires two arguments");
-        }
-    }
-}
-
-void XenoCompiler::compileSimpleCommand(const String& command, uint8_t opcode) {
-    emitInstruction(opcode);
-}
-
-bool XenoCompiler::validateString(const String& str) {
+bool XenoCompiler::validateString(std::string_view str) {
     if (str.length() > security_config.getMaxStringLength()) {
         Serial.println("ERROR: String too long");
         return false;
@@ -142,7 +33,7 @@ bool XenoCompiler::validateString(const String& str) {
     return true;
 }
 
-bool XenoCompiler::validateVariableName(const String& name) {
+bool XenoCompiler::validateVariableName(std::string_view name) {
     if (name.length() > security_config.getMaxVariableNameLength()) {
         Serial.println("ERROR: Variable name too long");
         return false;
@@ -154,72 +45,42 @@ bool XenoCompiler::validateVariableName(const String& name) {
     return true;
 }
 
-String XenoCompiler::cleanLine(const String& line) {
-    String cleaned = line;
-    int commentIndex = cleaned.indexOf("//");
-    if (commentIndex >= 0) {
-        cleaned = cleaned.substring(0, commentIndex);
-    }
-    cleaned.trim();
-    return cleaned;
-}
-
-int XenoCompiler::addString(const String& str) {
+int XenoCompiler::addString(std::string_view str) {
     if (!validateString(str)) {
-        return 0;
+        return REJECTED_STRING;
     }
 
-    for (int i = string_table.size() - 1; i >= 0; --i) {
-        if (string_table[i] == str) return i;
-    }
+    int existing = string_index.find(string_table, str);
+    if (existing >= 0) return existing;
 
     if (string_table.size() >= 65535) {
         Serial.println("ERROR: String table overflow");
-        return 0;
+        return REJECTED_STRING;
     }
 
-    string_table.push_back(str);
+    string_table.emplace_back(str);
+    string_index.insert(string_table, string_table.size() - 1);
     return string_table.size() - 1;
 }
 
-int XenoCompiler::getVariableIndex(const String& var_name) {
-    return validateVariableName(var_name) ? addString(var_name) : 0;
+int XenoCompiler::getVariableIndex(std::string_view var_name) {
+    return validateVariableName(var_name) ? addString(var_name) : REJECTED_STRING;
 }
 
 
 
-bool XenoCompiler::isFloat(const String& str) {
-    if (str.isEmpty() || str.length() > 32) return false;
-
-    const char* cstr = str.c_str();
-    bool has_decimal = false;
-    size_t start = 0;
-
-    if (cstr[0] == '-') start = 1;
-
-    for (size_t i = start; i < str.length(); ++i) {
-        if (cstr[i] == '.') {
-            if (has_decimal) return false;
-            has_decimal = true;
-        } else if (!isdigit(cstr[i])) {
-            return false;
-        }
-    }
-    return has_decimal && str.length() > 1;
-}
-
-bool XenoCompiler::isBool(const String& str) {
+bool XenoCompiler::isBool(std::string_view str) {
     return str == "true" || str == "false";
 }
 
-bool XenoCompiler::isQuotedString(const String& str) {
+bool XenoCompiler::isQuotedString(std::string_view str) {
     return str.length() >= 2 &&
            str[0] == '"' &&
            str[str.length() - 1] == '"';
 }
 
-bool XenoCompiler::isValidVariable(const String& str) {
-    if (str.isEmpty() || str.length() > security_config.getMaxVariableNameLength()) return false;
+bool XenoCompiler::isValidVariable(std::string_view str) {
+    if (str.empty() || str.length() > security_config.getMaxVariableNameLength()) return false;
 
     const char first = str[0];
     if (!isalpha(first) && first != '_') return false;
@@ -231,325 +92,296 @@ bool XenoCompiler::isValidVariable(const String& str) {
     return true;
 }
 
-bool XenoCompiler::isComparisonOperator(const String& str) {
-    return str == "==" || str == "!=" ||
-           str == "<"  || str == ">"  ||
-           str == "<=" || str == ">=";
-}
-
-int XenoCompiler::getPrecedence(const String& op) {
-    if (op == "^") return 4;
+int XenoCompiler::binaryPrecedence(const XenoToken& token) {
+    if (token.kind != TOKEN_OPERATOR) return 0;
+    std::string_view op = token.text;
+    if (op == "^") return 5;
     if (op == "*" || op == "/" || op == "%") return 3;
     if (op == "+" || op == "-") return 2;
-    if (isComparisonOperator(op)) return 1;
-    return 0;
+    return 1;
 }
 
-bool XenoCompiler::isRightAssociative(const String& op) {
-    return op == "^";
+uint8_t XenoCompiler::binaryOpcode(std::string_view op) {
+    if (op == "+") return OP_ADD;
+    if (op == "-") return OP_SUB;
+    if (op == "*") return OP_MUL;
+    if (op == "/") return OP_DIV;
+    if (op == "%") return OP_MOD;
+    if (op == "^") return OP_POW;
+    if (op == "==") return OP_EQ;
+    if (op == "!=") return OP_NEQ;
+    if (op == "<") return OP_LT;
+    if (op == ">") return OP_GT;
+    if (op == "<=") return OP_LTE;
+    return OP_GTE;
 }
 
-String XenoCompiler::processFunctions(const String& expr) {
-    if (expr.length() > 1024) {
-        Serial.println("ERROR: Expression too long");
-        return expr;
-    }
-
-    String result = expr;
-    int depth = 0;
-
-    processConstants(result);
+void XenoCompiler::expressionError(ExpressionParser& parser, const char* message) {
+    if (parser.failed) return;
+    parser.failed = true;
 
-    for (size_t i = 0; i < math_functions_count && depth < security_config.getMaxExpressionDepth(); i++) {
-        const FunctionInfo& func = math_functions[i];
-        int pos = result.indexOf(func.name);
-
-        while (pos >= 0 && depth < security_config.getMaxExpressionDepth()) {
-            int endPos = findMatchingParenthesis(result, pos + strlen(func.name) - 1);
-            if (endPos > pos) {
-                String inner = result.substring(pos + strlen(func.name), endPos);
-                inner = processFunctions(inner);
-                result = result.substring(0, pos)
-                        + String(func.open_bracket) + inner + String(func.close_bracket)
-                        + result.substring(endPos + 1);
-            } else {
-                break;
-            }
-            pos = result.indexOf(func.name);
-            depth++;
-        }
+    Serial.print("ERROR: ");
+    Serial.print(message);
+    if (parser.token.kind != TOKEN_END) {
+        Serial.print(" near '");
+        Serial.print(String(parser.token.text));
+        Serial.print("'");
     }
+    Serial.print(" at line ");
+    Serial.print(static_cast<int>(parser.token.line));
+    Serial.print(", column ");
+    Serial.println(static_cast<int>(parser.token.column));
+}
 
-    if (depth >= security_config.getMaxExpressionDepth()) {
-        Serial.println("ERROR: Expression too complex");
+bool XenoCompiler::enterNesting(ExpressionParser& parser) {
+    if (++parser.depth > security_config.getMaxExpressionDepth()) {
+        expressionError(parser, "Expression too complex");
+        return false;
     }
-
-    return result;
+    return true;
 }
 
-int XenoCompiler::findMatchingParenthesis(const String& expr, int start) {
-    int count = 1;
-    for (int i = start + 1; i < expr.length(); ++i) {
-        if (expr[i] == '(') ++count;
-        else if (expr[i] == ')') --count;
-
-        if (count == 0) return i;
+// Binary operators bind by precedence; ^ is right associative and binds
+// tighter than unary minus, so -2^2 is -(2^2)
+uint32_t XenoCompiler::parseExpression(ExpressionParser& parser, int min_precedence) {
+    uint32_t left = parseUnary(parser);
+    while (!parser.failed) {
+        int precedence = binaryPrecedence(parser.token);
+        if (precedence == 0 || precedence < min_precedence) break;
+
+        std::string_view op = parser.token.text;
+        parser.advance();
+        uint32_t right = parseExpression(parser, op == "^" ? precedence : precedence + 1);
+        if (parser.failed) break;
+
+        XenoExprNode node;
+        node.kind = XenoExprNode::EXPR_BINARY;
+        node.opcode = binaryOpcode(op);
+        node.left = left;
+        node.right = right;
+        left = expr_arena.add(node);
     }
-    return -1;
+    return left;
 }
 
-std::vector<String> XenoCompiler::infixToPostfix(const std::vector<String>& tokens) {
-    std::vector<String> output;
-    std::stack<String> operators;
-    output.reserve(tokens.size());
+uint32_t XenoCompiler::parseUnary(ExpressionParser& parser) {
+    static constexpr int UNARY_PRECEDENCE = 4;
 
-    if (tokens.size() > 100) {
-        Serial.println("ERROR: Too many tokens in expression");
-        return output;
+    if (parser.token.kind != TOKEN_OPERATOR ||
+        (parser.token.text != "-" && parser.token.text != "+")) {
+        return parsePrimary(parser);
     }
 
-    for (const String& token : tokens) {
-        if (isInteger(token) || isFloat(token) || isBool(token) || isQuotedString(token) ||
-            isValidVariable(token) ||
-            (token.startsWith("[") && token.endsWith("]")) ||
-            (token.startsWith("{") && token.endsWith("}")) ||
-            (token.startsWith("|") && token.endsWith("|")) ||
-            (token.startsWith("~") && token.endsWith("~"))) {
-            output.push_back(token);
-        } else if (token == "(") {
-            operators.push(token);
-        } else if (token == ")") {
-            while (!operators.empty() && operators.top() != "(") {
-                output.push_back(operators.top());
-                operators.pop();
-            }
-            if (!operators.empty()) operators.pop();
+    bool negate = parser.token.text == "-";
+    if (!enterNesting(parser)) return XenoExprNode::NONE;
+    parser.advance();
+    uint32_t operand = parseExpression(parser, UNARY_PRECEDENCE);
+    --parser.depth;
+    if (parser.failed || !negate) return operand;
+
+    // A negative literal is a constant, not a subtraction
+    XenoExprNode& inner = expr_arena[operand];
+    if (inner.kind == XenoExprNode::EXPR_NUMBER) {
+        if (inner.value.type == TYPE_FLOAT) {
+            inner.value.float_val = -inner.value.float_val;
         } else {
-            int token_precedence = getPrecedence(token);
-            while (!operators.empty() &&
-                    operators.top() != "(" &&
-                    (getPrecedence(operators.top()) > token_precedence ||
-                    (getPrecedence(operators.top()) == token_precedence &&
-                    !isRightAssociative(token))))  {
-                output.push_back(operators.top());
-                operators.pop();
-            }
-            operators.push(token);
+            inner.value.int_val = static_cast<int32_t>(0u - static_cast<uint32_t>(inner.value.int_val));
         }
+        return operand;
     }
 
-    while (!operators.empty()) {
-        output.push_back(operators.top());
-        operators.pop();
-    }
-
-    return output;
+    XenoExprNode node;
+    node.kind = XenoExprNode::EXPR_NEGATE;
+    node.left = operand;
+    return expr_arena.add(node);
 }
 
-std::vector<String> XenoCompiler::tokenizeExpression(const String& expr) {
-    std::vector<String> tokens;
-    String currentToken;
-    bool inQuotes = false;
-    bool inSpecial = false;
-    char specialChar = 0;
-    tokens.reserve(expr.length() / 2);
-
-    if (expr.length() > 1024) {
-        Serial.println("ERROR: Expression too long");
-        return tokens;
-    }
-
-    for (size_t i = 0; i < expr.length(); ++i) {
-        char c = expr[i];
-
-        if (c == '"' && !inSpecial) {
-            if (inQuotes) {
-                currentToken += c;
-                if (!validateString(currentToken)) {
-                    currentToken = "\"\"";
+uint32_t XenoCompiler::parsePrimary(ExpressionParser& parser) {
+    XenoToken token = parser.token;
+    XenoExprNode node;
+
+    switch (token.kind) {
+        case TOKEN_WORD: {
+            XenoKeyword keyword = token.keyword ? token.keyword->keyword : KEYWORD_NONE;
+            parser.advance();
+            if (XenoValue::parseNumber(token.text.data(), token.text.length(), node.value)) {
+                node.kind = XenoExprNode::EXPR_NUMBER;
+            } else if (keyword == KEYWORD_TRUE || keyword == KEYWORD_FALSE) {
+                node.kind = XenoExprNode::EXPR_BOOL;
+                node.value = XenoValue::makeBool(keyword == KEYWORD_TRUE);
+            } else if (parser.token.kind == TOKEN_LPAREN) {
+                if (keyword != KEYWORD_FUNCTION) {
+                    parser.token = token;
+                    expressionError(parser, "Unknown function");
+                    return XenoExprNode::NONE;
                 }
-                tokens.push_back(currentToken);
-                currentToken = "";
-                inQuotes = false;
+                return parseCall(parser, *token.keyword);
+            } else if (keyword == KEYWORD_CONSTANT) {
+                node.kind = XenoExprNode::EXPR_NUMBER;
+                XenoValue::parseNumber(token.keyword->value, strlen(token.keyword->value), node.value);
+            } else if (isValidVariable(token.text)) {
+                node.kind = XenoExprNode::EXPR_VARIABLE;
+                node.text = token.text;
             } else {
-                if (!currentToken.isEmpty()) {
-                    tokens.push_back(currentToken);
-                    currentToken = "";
-                }
-                inQuotes = true;
-                currentToken += c;
+                parser.token = token;
+                expressionError(parser, "Invalid operand");
+                return XenoExprNode::NONE;
             }
-            continue;
-        }
-
-        if (inQuotes) {
-            currentToken += c;
-            continue;
+            return expr_arena.add(node);
         }
 
-        if ((c == '[' || c == '{' || c == '|' || c == '~' || c == '#' || c == '@' || c == '&') && !inSpecial) {
-            if (!currentToken.isEmpty()) {
-                tokens.push_back(currentToken);
-                currentToken = "";
+        case TOKEN_STRING:
+            if (!isQuotedString(token.text)) {
+                expressionError(parser, "Unterminated string");
+                return XenoExprNode::NONE;
             }
-            inSpecial = true;
-            specialChar = c;
-            currentToken += c;
-            continue;
-        } else if (inSpecial && c == specialChar) {
-            currentToken += c;
-            tokens.push_back(currentToken);
-            currentToken = "";
-            inSpecial = false;
-            specialChar = 0;
-            continue;
-        }
-
-        if (inSpecial) {
-            currentToken += c;
-            continue;
-        }
-
-        if (isspace(c)) {
-            if (!currentToken.isEmpty()) {
-                tokens.push_back(currentToken);
-                currentToken = "";
+            parser.advance();
+            node.kind = XenoExprNode::EXPR_STRING;
+            node.text = token.text.substr(1, token.text.length() - 2);
+            if (!validateString(node.text)) node.text = std::string_view();
+            return expr_arena.add(node);
+
+        case TOKEN_LPAREN: {
+            if (!enterNesting(parser)) return XenoExprNode::NONE;
+            parser.advance();
+            uint32_t inner = parseExpression(parser, 1);
+            if (parser.failed) return XenoExprNode::NONE;
+            if (parser.token.kind != TOKEN_RPAREN) {
+                expressionError(parser, "Missing ')'");
+                return XenoExprNode::NONE;
             }
-            continue;
+            parser.advance();
+            --parser.depth;
+            return inner;
         }
 
-        if (i + 1 < expr.length()) {
-            String twoChar = expr.substring(i, i + 2);
-            if (twoChar == "==" || twoChar == "!=" ||
-                twoChar == "<=" || twoChar == ">=")  {
-                if (!currentToken.isEmpty()) {
-                    tokens.push_back(currentToken);
-                    currentToken = "";
-                }
-                tokens.push_back(twoChar);
-                ++i;
-                continue;
-            }
-        }
+        case TOKEN_END:
+            expressionError(parser, "Missing operand at end of expression");
+            return XenoExprNode::NONE;
 
-        if (c == '+' || c == '-' || c == '*' || c == '/' ||
-            c == '%' || c == '^' || c == '<' || c == '>' ||
-            c == '(' || c == ')') {
-            if (!currentToken.isEmpty()) {
-                tokens.push_back(currentToken);
-                currentToken = "";
-            }
-            tokens.push_back(String(c));
-        } else {
-            currentToken += c;
-        }
+        default:
+            expressionError(parser, "Unexpected token");
+            return XenoExprNode::NONE;
     }
+}
 
-    if (!currentToken.isEmpty()) {
-        tokens.push_back(currentToken);
-    }
+uint32_t XenoCompiler::parseCall(ExpressionParser& parser, const XenoKeywordEntry& func) {
+    if (!enterNesting(parser)) return XenoExprNode::NONE;
+    parser.advance();
 
-    return tokens;
-}
+    XenoExprNode node;
+    node.kind = XenoExprNode::EXPR_CALL;
+    node.opcode = func.opcode;
+    node.left = parseExpression(parser, 1);
+    if (parser.failed) return XenoExprNode::NONE;
 
-void XenoCompiler::compilePostfix(const std::vector<String>& postfix) {
-    if (postfix.size() > 100) {
-        Serial.println("ERROR: Postfix expression too complex");
-        return;
+    if (func.num_args == 2) {
+        if (parser.token.kind != TOKEN_COMMA) {
+            expressionError(parser, "Function requires two arguments");
+            return XenoExprNode::NONE;
+        }
+        parser.advance();
+        node.right = parseExpression(parser, 1);
+        if (parser.failed) return XenoExprNode::NONE;
     }
 
-    for (const String& token : postfix) {
-        if (isInteger(token)) {
-            int32_t value = token.toInt();
-            emitInstruction(OP_PUSH, static_cast<uint32_t>(value));
-        } else if (isFloat(token)) {
-            float fval = token.toFloat();
-            uint32_t fbits;
-            memcpy(&fbits, &fval, sizeof(float));
-            emitInstruction(OP_PUSH_FLOAT, fbits);
-        } else if (isBool(token)) {
-            bool bval = (token == "true");
-            emitInstruction(OP_PUSH_BOOL, bval);
-        } else if (isQuotedString(token)) {
-            String str = token.substring(1, token.length() - 1);
-            if (!validateString(str)) str = "";
-            int str_id = addString(str);
-            emitInstruction(OP_PUSH_STRING, str_id);
-        } else if (isValidVariable(token)) {
-            int var_index = getVariableIndex(token);
-            emitInstruction(OP_LOAD, var_index);
-        } else {
-            bool function_processed = false;
-            for (size_t i = 0; i < math_functions_count; i++) {
-                const FunctionInfo& func = math_functions[i];
-                if (token.startsWith(String(func.open_bracket)) &&
-                    token.endsWith(String(func.close_bracket))) {
-                    compileMathFunction(token, func);
-                    function_processed = true;
-                    break;
-                }
-            }
+    if (parser.token.kind != TOKEN_RPAREN) {
+        expressionError(parser, func.num_args == 2 ? "Missing ')'" : "Function takes one argument");
+        return XenoExprNode::NONE;
+    }
+    parser.advance();
+    --parser.depth;
+    return expr_arena.add(node);
+}
 
-            if (!function_processed) {
-                if (token == "+") emitInstruction(OP_ADD);
-                else if (token == "-") emitInstruction(OP_SUB);
-                else if (token == "*") emitInstruction(OP_MUL);
-                else if (token == "/") emitInstruction(OP_DIV);
-                else if (token == "%") emitInstruction(OP_MOD);
-                else if (token == "^") emitInstruction(OP_POW);
-                else if (token == "==") emitInstruction(OP_EQ);
-                else if (token == "!=") emitInstruction(OP_NEQ);
-                else if (token == "<") emitInstruction(OP_LT);
-                else if (token == ">") emitInstruction(OP_GT);
-                else if (token == "<=") emitInstruction(OP_LTE);
-                else if (token == ">=") emitInstruction(OP_GTE);
-            }
-        }
+void XenoCompiler::compileNode(uint32_t index) {
+    const XenoExprNode& node = expr_arena[index];
+    switch (node.kind) {
+        case XenoExprNode::EXPR_NUMBER:
+            emitPushNumber(node.value);
+            break;
+        case XenoExprNode::EXPR_BOOL:
+            emitInstruction(OP_PUSH_BOOL, node.value.bool_val);
+            break;
+        case XenoExprNode::EXPR_STRING:
+            emitInstruction(OP_PUSH_STRING, addString(node.text));
+            break;
+        case XenoExprNode::EXPR_VARIABLE:
+            emitInstruction(OP_LOAD, getVariableIndex(node.text));
+            break;
+        case XenoExprNode::EXPR_NEGATE:
+            emitInstruction(OP_PUSH, 0);
+            compileNode(node.left);
+            emitInstruction(OP_SUB);
+            break;
+        case XenoExprNode::EXPR_BINARY:
+        case XenoExprNode::EXPR_CALL:
+            compileNode(node.left);
+            if (node.right != XenoExprNode::NONE) compileNode(node.right);
+            emitInstruction(node.opcode);
+            break;
     }
 }
 
-void XenoCompiler::compileExpression(const String& expr) {
-    if (expr.isEmpty() || expr.length() > 1024) {
+void XenoCompiler::compileExpression(std::string_view expr) {
+    if (expr.empty()) {
         Serial.println("ERROR: Invalid expression");
         return;
     }
 
-    String processedExpr = processFunctions(expr);
-    std::vector<String> tokens = tokenizeExpression(processedExpr);
-    std::vector<String> postfix = infixToPostfix(tokens);
-    compilePostfix(postfix);
-}
+    // Expressions are views into the current source line
+    uint32_t column = 1;
+    if (expr.data() >= source_line.data() &&
+        expr.data() <= source_line.data() + source_line.length()) {
+        column += static_cast<uint32_t>(expr.data() - source_line.data());
+    }
 
-String XenoCompiler::extractVariableName(const String& text) {
-    return text.startsWith("$") ? text.substring(1) : "";
+    expr_arena.clear();
+    ExpressionParser parser(expr, source_line_number, column);
+    uint32_t root = parseExpression(parser, 1);
+    if (!parser.failed && parser.token.kind != TOKEN_END) {
+        expressionError(parser, "Unexpected token");
+    }
+    if (!parser.failed) {
+        compileNode(root);
+    }
+}
+std::string_view XenoCompiler::extractVariableName(std::string_view text) {
+    return (!text.empty() && text[0] == '$') ? text.substr(1) : std::string_view();
 }
 
-XenoDataType XenoCompiler::determineValueType(const String& value) {
+XenoDataType XenoCompiler::determineValueType(std::string_view value) {
     if (isQuotedString(value)) return TYPE_STRING;
-    if (isFloat(value)) return TYPE_FLOAT;
-    if (isInteger(value)) return TYPE_INT;
+    XenoValue number;
+    if (XenoValue::parseNumber(value.data(), value.length(), number)) return number.type;
     if (isBool(value)) return TYPE_BOOL;
     if (isValidVariable(value)) {
-        auto it = variable_map.find(value);
+        auto it = variable_map.find(String(value));
         return it != variable_map.end() ? it->second.type : TYPE_INT;
     }
     return TYPE_INT;
 }
 
-XenoValue XenoCompiler::createValueFromString(const String& str, XenoDataType type) {
+XenoValue XenoCompiler::createValueFromString(std::string_view str, XenoDataType type) {
     XenoValue value;
     value.type = type;
 
+    XenoValue number;
     switch (type) {
         case TYPE_INT:
-            value.int_val = str.toInt();
+            if (XenoValue::parseNumber(str.data(), str.length(), number)) {
+                value.int_val = number.type == TYPE_INT ? number.int_val
+                                                        : static_cast<int32_t>(number.float_val);
+            }
             break;
         case TYPE_FLOAT:
-            value.float_val = str.toFloat();
+            if (XenoValue::parseNumber(str.data(), str.length(), number)) {
+                value.float_val = number.type == TYPE_FLOAT ? number.float_val
+                                                            : static_cast<float>(number.int_val);
+            }
             break;
         case TYPE_STRING:
-            value.string_index = addString(
-                str.substring(1, str.length() - 1));
+            value.string_index = addString(str.substr(1, str.length() - 2));
             break;
         case TYPE_BOOL:
             value.bool_val = (str == "true");
@@ -566,279 +398,586 @@ void XenoCompiler::emitInstruction(uint8_t opcode, uint32_t arg1, uint16_t arg2)
     bytecode.emplace_back(opcode, arg1, arg2);
 }
 
+void XenoCompiler::emitPushNumber(const XenoValue& number) {
+    if (number.type == TYPE_FLOAT) {
+        uint32_t fbits;
+        memcpy(&fbits, &number.float_val, sizeof(float));
+        emitInstruction(OP_PUSH_FLOAT, fbits);
+    } else {
+        emitInstruction(OP_PUSH, static_cast<uint32_t>(number.int_val));
+    }
+}
+
 int XenoCompiler::getCurrentAddress() {
     return bytecode.size();
 }
 
-void XenoCompiler::compileLine(const String& line, int line_number) {
-    String cleanedLine = cleanLine(line);
-    if (cleanedLine.isEmpty()) return;
+namespace {
+
+// String::toInt semantics: leading number or 0, never throws
+int32_t parseInt(std::string_view text) {
+    const char* first = text.data();
+    const char* last = first + text.length();
+    while (first < last && isspace(static_cast<unsigned char>(*first))) ++first;
+    if (first < last && *first == '+') ++first;
+    int32_t value = 0;
+    std::from_chars_result result = std::from_chars(first, last, value);
+    return result.ec == std::errc() ? value : 0;
+}
 
-    if (cleanedLine.length() > 512) {
-        Serial.print("ERROR: Line too long at line ");
-        Serial.println(line_number);
+bool equalsIgnoreCase(std::string_view text, const char* lower) {
+    size_t i = 0;
+    for (; i < text.length(); ++i) {
+        if (lower[i] == '\0' || tolower(static_cast<unsigned char>(text[i])) != lower[i]) return false;
+    }
+    return lower[i] == '\0';
+}
+
+// Forwards compiler output and notes whether anything was printed
+class DiagnosticTap : public XenoIOContext {
+ public:
+    explicit DiagnosticTap(XenoIOContext& target) : target(target) {}
+    void write(const std::string& text) override {
+        printed = true;
+        target.write(text);
+    }
+    bool printed = false;
+
+ private:
+    XenoIOContext& target;
+};
+
+}  // namespace
+
+void XenoLineCache::clear() {
+    lines.clear();
+    reused_lines = 0;
+    compiled_lines = 0;
+}
+
+XenoLineCache::Stats XenoLineCache::getStats() const {
+    Stats stats;
+    stats.reused_lines = reused_lines;
+    stats.compiled_lines = compiled_lines;
+    stats.entries = lines.size();
+    return stats;
+}
+
+bool XenoCompiler::buildFragment(std::string_view line, int line_number, XenoLineFragment& fragment) {
+    source_line = line;
+    source_line_number = line_number;
+    // The fragment is compiled in place of the program
+    DiagnosticTap tap(XenoIOContext::current());
+    XenoIOScope tap_scope(tap);
+    fragment_index.clear();
+    bytecode.swap(fragment.code);
+    string_table.swap(fragment.strings);
+    string_index.swap(fragment_index);
+    compileFragment(XenoLexer::statement(line), line_number, fragment);
+    bytecode.swap(fragment.code);
+    string_table.swap(fragment.strings);
+    string_index.swap(fragment_index);
+    return !tap.printed;
+}
+
+void XenoCompiler::compileLine(std::string_view line, int line_number) {
+    // Imports depend on other files, so they are never cached
+    std::string_view statement = XenoLexer::statement(line);
+    if (isImport(statement)) {
+        importModule(statement, line_number);
         return;
     }
 
-    int firstSpace = cleanedLine.indexOf(' ');
-    String command = (firstSpace > 0) ? cleanedLine.substring(0, firstSpace) : cleanedLine;
-    String args = (firstSpace > 0) ? cleanedLine.substring(firstSpace + 1) : "";
-    args.trim();
-    command.toLowerCase();
+    if (line_cache) {
+        line_key.assign(line.data(), line.length());
+        auto it = line_cache->lines.find(line_key);
+        if (it != line_cache->lines.end()) {
+            it->second.generation = line_cache->generation;
+            ++line_cache->reused_lines;
+            linkFragment(it->second.fragment, line_number);
+            return;
+        }
+    }
 
-    bool simple_command_found = false;
-    for (size_t i = 0; i < simple_commands_count; i++) {
-        if (command == simple_commands[i].name) {
-            emitInstruction(simple_commands[i].opcode);
-            simple_command_found = true;
-            break;
+    // Linked right away, so diagnostics come out in source order
+    XenoLineFragment fragment;
+    bool clean = buildFragment(line, line_number, fragment);
+    linkFragment(fragment, line_number);
+
+    if (line_cache) {
+        ++line_cache->compiled_lines;
+        if (clean) {
+            XenoLineCache::Entry& entry = line_cache->lines[line_key];
+            entry.fragment = std::move(fragment);
+            entry.generation = line_cache->generation;
         }
     }
+}
 
-    if (simple_command_found) {
+void XenoCompiler::linkFragment(const XenoLineFragment& fragment, int line_number) {
+    // Checked again because a reused fragment may land at a deeper level
+    if (fragment.control == XenoLineFragment::LINE_IF &&
+        if_stack.size() >= security_config.getMaxIfDepth()) {
+        Serial.print("ERROR: IF nesting too deep at line ");
+        Serial.println(line_number);
+        return;
+    }
+    if (fragment.control == XenoLineFragment::LINE_FOR &&
+        loop_stack.size() >= security_config.getMaxLoopDepth()) {
+        Serial.print("ERROR: Loop nesting too deep at line ");
+        Serial.println(line_number);
         return;
     }
 
-    if (command == "print") {
-        String text = args;
-        String var_name = extractVariableName(text);
-        if (!var_name.isEmpty()) {
-            if (isValidVariable(var_name)) {
-                int var_index = getVariableIndex(var_name);
-                emitInstruction(OP_LOAD, var_index);
-                emitInstruction(OP_PRINT_NUM);
+    std::vector<uint32_t>& strings = link_strings;
+    strings.clear();
+    for (const String& str : fragment.strings) {
+        strings.push_back(addString(str.view()));
+    }
+
+    if (fragment.assigns_literal) {
+        XenoValue literal;
+        literal.type = fragment.assigned_type;
+        variable_map[fragment.assigned_var] = literal;
+    }
+
+    size_t code_size = fragment.code.size();
+    switch (fragment.control) {
+        case XenoLineFragment::LINE_CODE:
+            appendFragmentCode(fragment, strings, 0, code_size);
+            break;
+
+        case XenoLineFragment::LINE_IF: {
+            appendFragmentCode(fragment, strings, 0, code_size - 1);
+            int jump_addr = getCurrentAddress();
+            appendFragmentCode(fragment, strings, code_size - 1, code_size);
+            if_stack.push_back(jump_addr);
+            break;
+        }
+
+        case XenoLineFragment::LINE_ELSE:
+            if (!if_stack.empty()) {
+                int else_jump_addr = getCurrentAddress();
+                emitInstruction(OP_JUMP, 0);
+
+                int if_jump_addr = if_stack.back();
+                if (if_jump_addr < bytecode.size()) {
+                    bytecode[if_jump_addr].arg1 = getCurrentAddress();
+                }
+
+                if_stack.pop_back();
+                if_stack.push_back(else_jump_addr);
             } else {
-                Serial.print("ERROR: Invalid variable name in print at line ");
+                Serial.print("ERROR: ELSE without IF at line ");
                 Serial.println(line_number);
             }
-        } else {
-            if (text.startsWith("\"") && text.endsWith("\"")) {
-                text = text.substring(1, text.length() - 1);
-            }
-            if (!validateString(text)) {
-                text = "";
+            break;
+
+        case XenoLineFragment::LINE_ENDIF:
+            if (!if_stack.empty()) {
+                int jump_addr = if_stack.back();
+                if (jump_addr < bytecode.size()) {
+                    bytecode[jump_addr].arg1 = getCurrentAddress();
+                }
+                if_stack.pop_back();
+            } else {
+                Serial.print("ERROR: ENDIF without IF at line ");
+                Serial.println(line_number);
             }
-            int str_id = addString(text);
-            emitInstruction(OP_PRINT, str_id);
+            break;
+
+        case XenoLineFragment::LINE_FOR: {
+            appendFragmentCode(fragment, strings, 0, fragment.loop_start);
+            int loop_start = getCurrentAddress();
+            appendFragmentCode(fragment, strings, fragment.loop_start, code_size - 1);
+            int condition_jump = getCurrentAddress();
+            appendFragmentCode(fragment, strings, code_size - 1, code_size);
+
+            LoopInfo loop_info;
+            loop_info.var_name = fragment.loop_var;
+            loop_info.start_address = loop_start;
+            loop_info.condition_address = condition_jump;
+            loop_info.end_jump_address = getCurrentAddress();
+            loop_stack.push_back(loop_info);
+            break;
         }
-    } else if (command == "led") {
-        int spaceIndex = args.indexOf(' ');
-        if (spaceIndex > 0) {
-            String pin_str = args.substring(0, spaceIndex);
-            String state_str = args.substring(spaceIndex + 1);
-            state_str.trim();
-            state_str.toLowerCase();
-
-            int pin = pin_str.toInt();
-            if (pin < 0 || pin > 255) {
-                Serial.print("ERROR: Invalid pin number at line ");
+
+        case XenoLineFragment::LINE_ENDFOR:
+            if (!loop_stack.empty()) {
+                LoopInfo loop_info = loop_stack.back();
+                loop_stack.pop_back();
+
+                emitInstruction(OP_LOAD, getVariableIndex(loop_info.var_name.view()));
+                auto var_it = variable_map.find(loop_info.var_name);
+                if (var_it != variable_map.end() &&
+                    var_it->second.type == TYPE_FLOAT) {
+                    float increment = 1.0f;
+                    uint32_t increment_bits;
+                    memcpy(&increment_bits, &increment, sizeof(float));
+                    emitInstruction(OP_PUSH_FLOAT, increment_bits);
+                } else {
+                    emitInstruction(OP_PUSH, 1);
+                }
+                emitInstruction(OP_ADD);
+                emitInstruction(OP_STORE, getVariableIndex(loop_info.var_name.view()));
+                emitInstruction(OP_JUMP, loop_info.start_address);
+
+                if (loop_info.condition_address < bytecode.size()) {
+                    bytecode[loop_info.condition_address].arg1 = getCurrentAddress();
+                }
+            } else {
+                Serial.print("ERROR: ENDFOR without FOR at line ");
                 Serial.println(line_number);
-                return;
             }
+            break;
+    }
+}
+
+bool XenoCompiler::isImport(std::string_view statement) {
+    std::string_view command = statement.substr(0, statement.find(' '));
+    const XenoKeywordEntry* keyword = xeno_statement_keywords.find(command);
+    return keyword && keyword->keyword == KEYWORD_IMPORT;
+}
+
+void XenoCompiler::importModule(std::string_view statement, int line_number) {
+    size_t space = statement.find(' ');
+    std::string_view name = space != std::string_view::npos
+                          ? XenoLexer::trim(statement.substr(space + 1))
+                          : std::string_view();
+    if (name.length() < 3 || name.front() != '"' || name.back() != '"') {
+        Serial.print("ERROR: Invalid import at line ");
+        Serial.println(line_number);
+        return;
+    }
+    has_imports = true;
+    if (!module_resolver) {
+        Serial.print("ERROR: Modules cannot be imported here at line ");
+        Serial.println(line_number);
+        return;
+    }
+
+    std::shared_ptr<const XenoModule> module = module_resolver(name.substr(1, name.length() - 2),
+                                                               line_number);
+    if (!module ||
+        std::find(linked_modules.begin(), linked_modules.end(), module->name) != linked_modules.end()) {
+        return;
+    }
+    linked_modules.push_back(module->name);
+    linked_modules.insert(linked_modules.end(), module->contained.begin(), module->contained.end());
+    XenoIOContext::current().write(module->diagnostics);
+    linkModule(*module);
+}
+
+void XenoCompiler::linkModule(const XenoModule& module) {
+    if (bytecode.size() + module.code.size() > 65535) {
+        Serial.println("ERROR: Program too large");
+        return;
+    }
+
+    std::vector<uint32_t>& strings = link_strings;
+    strings.clear();
+    for (const String& str : module.strings) {
+        strings.push_back(addString(str.view()));
+    }
+    for (const auto& variable : module.variable_types) {
+        XenoValue literal;
+        literal.type = variable.second;
+        variable_map[variable.first] = literal;
+    }
+
+    // Relocate string operands into this program's table and jumps past
+    // the code before the module
+    uint32_t base = bytecode.size();
+    for (const XenoInstruction& instr : module.code) {
+        uint32_t arg1 = instr.arg1;
+        switch (instr.opcode) {
+            case OP_PRINT:
+            case OP_PUSH_STRING:
+            case OP_LOAD:
+            case OP_STORE:
+            case OP_INPUT:
+                arg1 = arg1 < strings.size() ? strings[arg1] : 0;
+                break;
+            case OP_JUMP:
+            case OP_JUMP_IF:
+                arg1 += base;
+                break;
+        }
+        bytecode.emplace_back(instr.opcode, arg1, instr.arg2);
+    }
+}
+
+bool XenoCompiler::compileModule(const String& source_code, XenoModule& module) {
+    beginCompile();
+    compileChunk(source_code.view());
+    compileSourceLine(pending_line);
+    pending_line.clear();
+    if (!if_stack.empty() || !loop_stack.empty()) {
+        return false;
+    }
+
+    module.code = bytecode;
+    module.strings = string_table;
+    module.variable_types.clear();
+    for (const auto& variable : variable_map) {
+        module.variable_types.emplace_back(variable.first, variable.second.type);
+    }
+    module.contained = linked_modules;
+    return true;
+}
+
+void XenoCompiler::appendFragmentCode(const XenoLineFragment& fragment,
+                                      const std::vector<uint32_t>& strings,
+                                      size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        const XenoInstruction& instr = fragment.code[i];
+        uint32_t arg1 = instr.arg1;
+        switch (instr.opcode) {
+            case OP_PRINT:
+            case OP_PUSH_STRING:
+            case OP_LOAD:
+            case OP_STORE:
+            case OP_INPUT:
+                arg1 = arg1 < strings.size() ? strings[arg1] : 0;
+                break;
+        }
+        emitInstruction(instr.opcode, arg1, instr.arg2);
+    }
+}
+
+void XenoCompiler::compileFragment(std::string_view cleanedLine, int line_number,
+                                   XenoLineFragment& fragment) {
+    if (cleanedLine.empty()) return;
+
+    if (cleanedLine.length() > 512) {
+        Serial.print("ERROR: Line too long at line ");
+        Serial.println(line_number);
+        return;
+    }
+
+    size_t firstSpace = cleanedLine.find(' ');
+    std::string_view command = cleanedLine.substr(0, firstSpace);
+    std::string_view args = firstSpace != std::string_view::npos
+                          ? XenoLexer::trim(cleanedLine.substr(firstSpace + 1))
+                          : std::string_view();
+
+    const XenoKeywordEntry* keyword = xeno_statement_keywords.find(command);
+    switch (keyword ? keyword->keyword : KEYWORD_NONE) {
+        case KEYWORD_STACK_OP:
+            emitInstruction(keyword->opcode);
+            break;
+        case KEYWORD_PRINT: {
+            std::string_view text = args;
+            std::string_view var_name = extractVariableName(text);
+            if (!var_name.empty()) {
+                if (isValidVariable(var_name)) {
+                    int var_index = getVariableIndex(var_name);
+                    emitInstruction(OP_LOAD, var_index);
+                    emitInstruction(OP_PRINT_NUM);
+                } else {
+                    Serial.print("ERROR: Invalid variable name in print at line ");
+                    Serial.println(line_number);
+                }
+            } else {
+                if (!text.empty() && text.front() == '"' && text.back() == '"') {
+                    text = text.length() >= 2 ? text.substr(1, text.length() - 2) : std::string_view();
+                }
+                if (!validateString(text)) {
+                    text = std::string_view();
+                }
+                int str_id = addString(text);
+                emitInstruction(OP_PRINT, str_id);
+            }
+            break;
+        }
+        case KEYWORD_LED: {
+            size_t spaceIndex = args.find(' ');
+            if (spaceIndex != std::string_view::npos && spaceIndex > 0) {
+                std::string_view pin_str = args.substr(0, spaceIndex);
+                std::string_view state_str = XenoLexer::trim(args.substr(spaceIndex + 1));
+
+                int pin = parseInt(pin_str);
+                if (pin < 0 || pin > 255) {
+                    Serial.print("ERROR: Invalid pin number at line ");
+                    Serial.println(line_number);
+                    return;
+                }
 
-            if (state_str == "on" || state_str == "1" || state_str == "true") {
-                emitInstruction(OP_LED_ON, pin);
-            } else if (state_str == "off" || state_str == "0" || state_str == "false") {
-                emitInstruction(OP_LED_OFF, pin);
+                if (equalsIgnoreCase(state_str, "on") || state_str == "1" ||
+                    equalsIgnoreCase(state_str, "true")) {
+                    emitInstruction(OP_LED_ON, pin);
+                } else if (equalsIgnoreCase(state_str, "off") || state_str == "0" ||
+                           equalsIgnoreCase(state_str, "false")) {
+                    emitInstruction(OP_LED_OFF, pin);
+                } else {
+                    Serial.print("WARNING: Unknown LED state at line ");
+                    Serial.println(line_number);
+                }
             } else {
-                Serial.print("WARNING: Unknown LED state at line ");
+                Serial.print("WARNING: Invalid LED command at line ");
                 Serial.println(line_number);
             }
-        } else {
-            Serial.print("WARNING: Invalid LED command at line ");
-            Serial.println(line_number);
-        }
-    } else if (command == "delay") {
-        int delay_time = args.toInt();
-        if (delay_time < 0 || delay_time > 60000) {
-            Serial.print("WARNING: Delay time out of range at line ");
-            Serial.println(line_number);
-            delay_time = min(max(delay_time, 0), 60000);
+            break;
         }
-        emitInstruction(OP_DELAY, delay_time);
-    } else if (command == "push") {
-        if (isValidVariable(args)) {
-            int var_index = getVariableIndex(args);
-            emitInstruction(OP_LOAD, var_index);
-        } else if (isFloat(args)) {
-            float fval = args.toFloat();
-            uint32_t fbits;
-            memcpy(&fbits, &fval, sizeof(float));
-            emitInstruction(OP_PUSH_FLOAT, fbits);
-        } else if (isBool(args)) {
-            bool bval = (args == "true");
-            emitInstruction(OP_PUSH_BOOL, bval);
-        } else if (isQuotedString(args)) {
-            String str = args.substring(1, args.length() - 1);
-            if (!validateString(str)) {
-                str = "";
+        case KEYWORD_DELAY: {
+            int delay_time = parseInt(args);
+            if (delay_time < 0 || delay_time > 60000) {
+                Serial.print("WARNING: Delay time out of range at line ");
+                Serial.println(line_number);
+                delay_time = min(max(delay_time, 0), 60000);
             }
-            int str_id = addString(str);
-            emitInstruction(OP_PUSH_STRING, str_id);
-        } else {
-            int32_t value = args.toInt();
-            emitInstruction(OP_PUSH, static_cast<uint32_t>(value));
+            emitInstruction(OP_DELAY, delay_time);
+            break;
         }
-    } else if (command == "input") {
-        String var_name = args;
-        if (!validateVariableName(var_name)) {
-            Serial.print("ERROR: Invalid variable name for input at line ");
-            Serial.println(line_number);
-            return;
+        case KEYWORD_PUSH: {
+            XenoValue number;
+            if (isValidVariable(args)) {
+                int var_index = getVariableIndex(args);
+                emitInstruction(OP_LOAD, var_index);
+            } else if (XenoValue::parseNumber(args.data(), args.length(), number) &&
+                       number.type == TYPE_FLOAT) {
+                emitPushNumber(number);
+            } else if (isBool(args)) {
+                bool bval = (args == "true");
+                emitInstruction(OP_PUSH_BOOL, bval);
+            } else if (isQuotedString(args)) {
+                std::string_view str = args.substr(1, args.length() - 2);
+                if (!validateString(str)) {
+                    str = std::string_view();
+                }
+                int str_id = addString(str);
+                emitInstruction(OP_PUSH_STRING, str_id);
+            } else {
+                int32_t value = parseInt(args);
+                emitInstruction(OP_PUSH, static_cast<uint32_t>(value));
+            }
+            break;
         }
-        int var_index = getVariableIndex(var_name);
-        emitInstruction(OP_INPUT, var_index);
-    } else if (command == "set") {
-        int space1 = args.indexOf(' ');
-        if (space1 > 0) {
-            String var_name = args.substring(0, space1);
-            String expression = args.substring(space1 + 1);
-
+        case KEYWORD_INPUT: {
+            std::string_view var_name = args;
             if (!validateVariableName(var_name)) {
-                Serial.print("ERROR: Invalid variable name '");
-                Serial.print(var_name);
-                Serial.print("' at line ");
-                Serial.print(line_number);
+                Serial.print("ERROR: Invalid variable name for input at line ");
+                Serial.println(line_number);
                 return;
             }
-
-            XenoDataType value_type = determineValueType(expression);
-            if (isInteger(expression) || isFloat(expression) || isQuotedString(expression) || isBool(expression)) {
-                variable_map[var_name] = createValueFromString(expression, value_type);
-            }
-
-            compileExpression(expression);
-            emitInstruction(OP_STORE, getVariableIndex(var_name));
-        } else {
-            Serial.print("ERROR: Invalid SET command at line ");
-            Serial.println(line_number);
-        }
-    } else if (command == "if") {
-        if (if_stack.size() >= security_config.getMaxIfDepth()) {
-            Serial.print("ERROR: IF nesting too deep at line ");
-            Serial.println(line_number);
-            return;
+            int var_index = getVariableIndex(var_name);
+            emitInstruction(OP_INPUT, var_index);
+            break;
         }
+        case KEYWORD_SET: {
+            size_t space1 = args.find(' ');
+            if (space1 != std::string_view::npos && space1 > 0) {
+                std::string_view var_name = args.substr(0, space1);
+                std::string_view expression = args.substr(space1 + 1);
+
+                if (!validateVariableName(var_name)) {
+                    Serial.print("ERROR: Invalid variable name '");
+                    Serial.print(String(var_name));
+                    Serial.print("' at line ");
+                    Serial.print(line_number);
+                    return;
+                }
 
-        int thenPos = args.indexOf(" then");
-        if (thenPos > 0) {
-            String condition = args.substring(0, thenPos);
-            compileExpression(condition);
+                XenoValue literal;
+                if (XenoValue::parseNumber(expression.data(), expression.length(), literal)) {
+                    fragment.assigns_literal = true;
+                } else if (isQuotedString(expression) || isBool(expression)) {
+                    literal = createValueFromString(expression, determineValueType(expression));
+                    fragment.assigns_literal = true;
+                }
+                if (fragment.assigns_literal) {
+                    fragment.assigned_var = String(var_name);
+                    fragment.assigned_type = literal.type;
+                }
 
-            int jump_addr = getCurrentAddress();
-            emitInstruction(OP_JUMP_IF, 0);
-            if_stack.push_back(jump_addr);
-        } else {
-            Serial.print("ERROR: Invalid IF command at line ");
-            Serial.println(line_number);
+                compileExpression(expression);
+                emitInstruction(OP_STORE, getVariableIndex(var_name));
+            } else {
+                Serial.print("ERROR: Invalid SET command at line ");
+                Serial.println(line_number);
+            }
+            break;
         }
-    } else if (command == "else") {
-        if (!if_stack.empty()) {
-            int else_jump_addr = getCurrentAddress();
-            emitInstruction(OP_JUMP, 0);
-
-            int if_jump_addr = if_stack.back();
-            if (if_jump_addr < bytecode.size()) {
-                bytecode[if_jump_addr].arg1 = getCurrentAddress();
+        case KEYWORD_IF: {
+            if (if_stack.size() >= security_config.getMaxIfDepth()) {
+                Serial.print("ERROR: IF nesting too deep at line ");
+                Serial.println(line_number);
+                return;
             }
 
-            if_stack.pop_back();
-            if_stack.push_back(else_jump_addr);
-        } else {
-            Serial.print("ERROR: ELSE without IF at line ");
-            Serial.println(line_number);
-        }
-    } else if (command == "endif") {
-        if (!if_stack.empty()) {
-            int jump_addr = if_stack.back();
-            if (jump_addr < bytecode.size()) {
-                bytecode[jump_addr].arg1 = getCurrentAddress();
+            size_t thenPos = args.find(" then");
+            if (thenPos != std::string_view::npos && thenPos > 0) {
+                compileExpression(args.substr(0, thenPos));
+                emitInstruction(OP_JUMP_IF, 0);
+                fragment.control = XenoLineFragment::LINE_IF;
+            } else {
+                Serial.print("ERROR: Invalid IF command at line ");
+                Serial.println(line_number);
             }
-            if_stack.pop_back();
-        } else {
-            Serial.print("ERROR: ENDIF without IF at line ");
-            Serial.println(line_number);
+            break;
         }
-    } else if (command == "for") {
-        if (loop_stack.size() >= security_config.getMaxLoopDepth()) {
-            Serial.print("ERROR: Loop nesting too deep at line ");
-            Serial.println(line_number);
-            return;
+        case KEYWORD_ELSE: {
+            fragment.control = XenoLineFragment::LINE_ELSE;
+            break;
         }
-
-        int equalsPos = args.indexOf('=');
-        int toPos = args.indexOf(" to ");
-
-        if (equalsPos > 0 && toPos > equalsPos) {
-            String var_name = args.substring(0, equalsPos);
-            var_name.trim();
-
-            if (!validateVariableName(var_name)) {
-                Serial.print("ERROR: Invalid variable name in FOR at line ");
+        case KEYWORD_ENDIF: {
+            fragment.control = XenoLineFragment::LINE_ENDIF;
+            break;
+        }
+        case KEYWORD_FOR: {
+            if (loop_stack.size() >= security_config.getMaxLoopDepth()) {
+                Serial.print("ERROR: Loop nesting too deep at line ");
                 Serial.println(line_number);
                 return;
             }
 
-            String start_expr = args.substring(equalsPos + 1, toPos);
-            start_expr.trim();
-            String end_expr = args.substring(toPos + 4);
-            end_expr.trim();
+            size_t equalsPos = args.find('=');
+            size_t toPos = args.find(" to ");
 
-            compileExpression(start_expr);
-            int var_index = getVariableIndex(var_name);
-            emitInstruction(OP_STORE, var_index);
+            if (equalsPos != std::string_view::npos && equalsPos > 0 &&
+                toPos != std::string_view::npos && toPos > equalsPos) {
+                std::string_view var_name = XenoLexer::trim(args.substr(0, equalsPos));
 
-            int loop_start = getCurrentAddress();
-            emitInstruction(OP_LOAD, var_index);
-            compileExpression(end_expr);
-            emitInstruction(OP_LTE);
+                if (!validateVariableName(var_name)) {
+                    Serial.print("ERROR: Invalid variable name in FOR at line ");
+                    Serial.println(line_number);
+                    return;
+                }
 
-            int condition_jump = getCurrentAddress();
-            emitInstruction(OP_JUMP_IF, 0);
+                std::string_view start_expr = XenoLexer::trim(args.substr(equalsPos + 1, toPos - equalsPos - 1));
+                std::string_view end_expr = XenoLexer::trim(args.substr(toPos + 4));
 
-            LoopInfo loop_info;
-            loop_info.var_name = var_name;
-            loop_info.start_address = loop_start;
-            loop_info.condition_address = condition_jump;
-            loop_info.end_jump_address = getCurrentAddress();
-            loop_stack.push_back(loop_info);
+                compileExpression(start_expr);
+                int var_index = getVariableIndex(var_name);
+                emitInstruction(OP_STORE, var_index);
 
-        } else {
-            Serial.print("ERROR: Invalid FOR command at line ");
-            Serial.println(line_number);
-        }
-    } else if (command == "endfor") {
-        if (!loop_stack.empty()) {
-            LoopInfo loop_info = loop_stack.back();
-            loop_stack.pop_back();
-
-            emitInstruction(OP_LOAD, getVariableIndex(loop_info.var_name));
-            auto var_it = variable_map.find(loop_info.var_name);
-            if (var_it != variable_map.end() &&
-                var_it->second.type == TYPE_FLOAT) {
-                float increment = 1.0f;
-                uint32_t increment_bits;
-                memcpy(&increment_bits, &increment, sizeof(float));
-                emitInstruction(OP_PUSH_FLOAT, increment_bits);
-            } else {
-                emitInstruction(OP_PUSH, 1);
-            }
-            emitInstruction(OP_ADD);
-            emitInstruction(OP_STORE, getVariableIndex(loop_info.var_name));
-            emitInstruction(OP_JUMP, loop_info.start_address);
+                fragment.loop_start = getCurrentAddress();
+                emitInstruction(OP_LOAD, var_index);
+                compileExpression(end_expr);
+                emitInstruction(OP_LTE);
+                emitInstruction(OP_JUMP_IF, 0);
 
-            if (loop_info.condition_address < bytecode.size()) {
-                bytecode[loop_info.condition_address].arg1 = getCurrentAddress();
+                fragment.control = XenoLineFragment::LINE_FOR;
+                fragment.loop_var = String(var_name);
+            } else {
+                Serial.print("ERROR: Invalid FOR command at line ");
+                Serial.println(line_number);
             }
-        } else {
-            Serial.print("ERROR: ENDFOR without FOR at line ");
-            Serial.println(line_number);
+            break;
+        }
+        case KEYWORD_ENDFOR: {
+            fragment.control = XenoLineFragment::LINE_ENDFOR;
+            break;
+        }
+        default: {
+            String lowered(command);
+            lowered.toLowerCase();
+            Serial.print("WARNING: Unknown command at line ");
+            Serial.print(line_number);
+            Serial.print(": ");
+            Serial.println(lowered);
+            break;
         }
-    } else {
-        Serial.print("WARNING: Unknown command at line ");
-        Serial.print(line_number);
-        Serial.print(": ");
-        Serial.println(command);
     }
 }
 
@@ -850,41 +989,177 @@ XenoCompiler::XenoCompiler(XenoSecurityConfig& config)
     loop_stack.reserve(security_config.getMaxLoopDepth());
 }
 
-void XenoCompiler::compile(const String& source_code) {
+void XenoCompiler::beginCompile() {
     bytecode.clear();
     string_table.clear();
+    string_index.clear();
     variable_map.clear();
     if_stack.clear();
     loop_stack.clear();
+    pending_line.clear();
+    stream_line_number = 1;
+    linked_modules.clear();
+    has_imports = false;
+    if (line_cache) {
+        ++line_cache->generation;
+        line_cache->reused_lines = 0;
+        line_cache->compiled_lines = 0;
+    }
+}
 
-    int line_number = 0;
-    int startPos = 0;
-    int endPos = source_code.indexOf('\n');
+void XenoCompiler::compileSourceLine(std::string_view line) {
+    if (!line.empty()) {
+        compileLine(line, stream_line_number);
+    }
+    ++stream_line_number;
+}
+
+void XenoCompiler::compileChunk(std::string_view chunk) {
+    size_t start = 0;
+    size_t end;
+    while ((end = chunk.find('\n', start)) != std::string_view::npos) {
+        std::string_view line = chunk.substr(start, end - start);
+        if (pending_line.empty()) {
+            compileSourceLine(line);
+        } else {
+            // The line began in an earlier chunk
+            pending_line.append(line);
+            compileSourceLine(pending_line);
+            pending_line.clear();
+        }
+        start = end + 1;
+    }
+    pending_line.append(chunk.substr(start));
+}
 
-    while (endPos >= 0) {
-        String line = source_code.substring(startPos, endPos);
-        ++line_number;
+void XenoCompiler::finishCompile() {
+    compileSourceLine(pending_line);
+    pending_line.clear();
 
-        if (!line.isEmpty()) {
-            compileLine(line, line_number);
+    if (bytecode.empty() || bytecode.back().opcode != OP_HALT) {
+        bytecode.emplace_back(OP_HALT);
+    }
+    // Names the optimizer adds must survive the VM's string sanitizing
+    // unchanged and keep the program within the verifier's string limit
+    auto add_name = [this](std::string_view name) {
+        if (name.length() >= security_config.getMaxStringLength() ||
+            string_table.size() >= XenoSecurity::MAX_STRING_COUNT) {
+            return -1;
+        }
+        int existing = string_index.find(string_table, name);
+        if (existing >= 0) return existing;
+        string_table.emplace_back(name);
+        string_index.insert(string_table, string_table.size() - 1);
+        return static_cast<int>(string_table.size() - 1);
+    };
+    optimizer_stats = XenoOptimizer(bytecode, add_name, security_config.getMaxStackSize())
+                         .run(optimization_level);
+
+    // Keep only the lines of this program so the cache tracks the source
+    if (line_cache) {
+        for (auto it = line_cache->lines.begin(); it != line_cache->lines.end();) {
+            if (it->second.generation != line_cache->generation) {
+                it = line_cache->lines.erase(it);
+            } else {
+                ++it;
+            }
         }
+    }
+}
 
-        startPos = endPos + 1;
-        endPos = source_code.indexOf('\n', startPos);
+void XenoCompiler::compile(const String& source_code) {
+    beginCompile();
+    compileChunk(source_code.view());
+    finishCompile();
+}
+
+void XenoCompiler::compileParallel(const String& source_code, XenoThreadPool& pool) {
+    static constexpr size_t NO_FRAGMENT = SIZE_MAX;
+    struct SourceLine {
+        std::string_view text;
+        int number;
+        size_t fragment;
+    };
+
+    beginCompile();
+
+    // Every distinct line that is not cached yet is compiled once
+    std::vector<SourceLine> lines;
+    std::vector<std::string_view> distinct;
+    std::unordered_map<std::string_view, size_t> fragment_of;
+    XenoLexer lexer(source_code.view());
+    std::string_view line;
+    while (lexer.nextLine(line)) {
+        if (line.empty()) continue;
+        size_t fragment = NO_FRAGMENT;
+        if (line_cache) line_key.assign(line.data(), line.length());
+        if (isImport(XenoLexer::statement(line))) {
+            // Linked in order below
+        } else if (!line_cache || line_cache->lines.find(line_key) == line_cache->lines.end()) {
+            auto inserted = fragment_of.emplace(line, distinct.size());
+            if (inserted.second) distinct.push_back(line);
+            fragment = inserted.first->second;
+        }
+        lines.push_back({line, static_cast<int>(lexer.lineNumber()), fragment});
     }
 
-    String lastLine = source_code.substring(startPos);
-    if (!lastLine.isEmpty()) {
-        compileLine(lastLine, ++line_number);
+    // Fragments do not depend on the lines around them, so they can be
+    // built in any order. Messages are dropped here; a line that printed
+    // any is compiled again below so they appear in source order.
+    std::vector<XenoLineFragment> fragments(distinct.size());
+    std::vector<uint8_t> clean(distinct.size(), 0);
+    if (pool.size() > 1 && distinct.size() >= PARALLEL_MIN_LINES) {
+        size_t regions = min(distinct.size(), pool.size() * 4);
+        for (size_t r = 0; r < regions; ++r) {
+            size_t begin = distinct.size() * r / regions;
+            size_t end = distinct.size() * (r + 1) / regions;
+            pool.submit([this, &distinct, &fragments, &clean, begin, end]() {
+                XenoBufferedIO discard([](const std::string&) {});
+                XenoIOScope discard_scope(discard);
+                XenoCompiler worker(security_config);
+                for (size_t i = begin; i < end; ++i) {
+                    clean[i] = worker.buildFragment(distinct[i], 0, fragments[i]);
+                }
+            });
+        }
+        pool.waitIdle();
     }
 
-    if (bytecode.empty() || bytecode.back().opcode != OP_HALT) {
-        bytecode.emplace_back(OP_HALT);
+    // Linking stays serial: it resolves blocks, interns strings and
+    // updates the line cache exactly like compile()
+    for (const SourceLine& source : lines) {
+        if (source.fragment == NO_FRAGMENT || !clean[source.fragment]) {
+            compileLine(source.text, source.number);
+            continue;
+        }
+        const XenoLineFragment& fragment = fragments[source.fragment];
+        linkFragment(fragment, source.number);
+        if (line_cache) {
+            auto entry = line_cache->lines.try_emplace(std::string(source.text));
+            if (entry.second) {
+                entry.first->second.fragment = fragment;
+                ++line_cache->compiled_lines;
+            } else {
+                ++line_cache->reused_lines;
+            }
+            entry.first->second.generation = line_cache->generation;
+        }
     }
+
+    finishCompile();
 }
 
 const std::vector<XenoInstruction>& XenoCompiler::getBytecode() const { return bytecode; }
 const std::vector<String>& XenoCompiler::getStringTable() const { return string_table; }
+const XenoStringIndex& XenoCompiler::getStringIndex() const { return string_index; }
+
+void XenoCompiler::setProgram(std::vector<XenoInstruction> code, std::vector<String> strings,
+                              const XenoOptimizer::Stats& stats) {
+    bytecode = std::move(code);
+    optimizer_stats = stats;
+    string_table = std::move(strings);
+    string_index.rebuild(string_table);
+}
 
 void XenoCompiler::printCompiledCode() {
     Debugger::disassemble(bytecode, string_table, "Compiled Xeno Program", true);
@@ -20,86 +20,221 @@
 #include <vector>
 #include <map>
 #include <stack>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <algorithm>
+#include <functional>
+#include <memory>
+#include <utility>
 #include "../xeno_common.h"
+#include "xeno_lexer.h"
+#include "xeno_ast.h"
+#include "xeno_optimizer.h"
 #include "../security/xeno_security.h"
 #include "arduino_compat.h"
 #define String XenoString
 
 
+// One compiled source line. String operands index the fragment's own
+// string table and control flow is resolved when the line is linked into
+// the program, so a fragment does not depend on where the line ends up.
+struct XenoLineFragment {
+    enum Control : uint8_t {
+        LINE_CODE,
+        LINE_IF,
+        LINE_ELSE,
+        LINE_ENDIF,
+        LINE_FOR,
+        LINE_ENDFOR
+    };
+
+    Control control = LINE_CODE;
+    std::vector<XenoInstruction> code;
+    std::vector<String> strings;
+
+    // SET with a literal records the variable type, ENDFOR increments by it
+    bool assigns_literal = false;
+    String assigned_var;
+    XenoDataType assigned_type = TYPE_INT;
+
+    // FOR: the loop variable and the offset of the loop condition in code
+    String loop_var;
+    uint32_t loop_start = 0;
+};
+
+// Fragments of the lines seen by the last compile, keyed by the raw line
+// text. Recompiling after an edit only compiles the lines that changed;
+// the rest are relinked. Lines that produced diagnostics are not kept.
+class XenoLineCache {
+ public:
+    struct Stats {
+        size_t reused_lines = 0;
+        size_t compiled_lines = 0;
+        size_t entries = 0;
+    };
+
+    void clear();
+    Stats getStats() const;
+
+ private:
+    friend class XenoCompiler;
+
+    struct Entry {
+        XenoLineFragment fragment;
+        uint32_t generation = 0;
+    };
+
+    std::unordered_map<std::string, Entry> lines;
+    uint32_t generation = 0;
+    size_t reused_lines = 0;
+    size_t compiled_lines = 0;
+};
+
+// A separately compiled source file, linked into programs that import it.
+// Jump targets are relative to the start of code and string operands index
+// the module's own strings, so the linker can place it anywhere.
+struct XenoModule {
+    // Canonical path; a program links each module once
+    std::string name;
+    std::vector<XenoInstruction> code;
+    std::vector<String> strings;
+    // Types of the variables the module assigns literals to
+    std::vector<std::pair<String, XenoDataType>> variable_types;
+    // Modules the module imported itself; their code is already in code
+    std::vector<std::string> contained;
+    // Compiler messages, shown again whenever the cached module is reused
+    std::string diagnostics;
+};
+
+class XenoThreadPool;
+
 class XenoCompiler {
  private:
     std::vector<XenoInstruction> bytecode;
     std::vector<String> string_table;
+    XenoStringIndex string_index;
     std::map<String, XenoValue> variable_map;
     std::vector<int> if_stack;
     std::vector<LoopInfo> loop_stack;
     XenoSecurityConfig& security_config;
     XenoSecurity security;
+    XenoLineCache* line_cache = nullptr;
+    // Scratch buffers reused for every line
+    std::string line_key;
+    std::vector<uint32_t> link_strings;
+    XenoStringIndex fragment_index;
+    // Streaming state: the line still waiting for its end and its number
+    std::string pending_line;
+    int stream_line_number = 1;
+    XenoExprArena expr_arena;
+    // Loads modules for import lines; the modules linked into this program
+    std::function<std::shared_ptr<const XenoModule>(std::string_view, int)> module_resolver;
+    std::vector<std::string> linked_modules;
+    bool has_imports = false;
+    uint8_t optimization_level = 0;
+    XenoOptimizer::Stats optimizer_stats;
+    // Source line being compiled, for expression error positions
+    std::string_view source_line;
+    int source_line_number = 0;
+    // Index used for a rejected string or variable name; the linker maps it
+    // to string 0
+    static constexpr int REJECTED_STRING = -1;
 
-    struct Constant {
-        const char* name;
-        const char* value;
-    };
-    static const Constant constants[];
-    static const size_t constants_count;
-
-    struct FunctionInfo {
-        const char* name;
-        char open_bracket;
-        char close_bracket;
-        uint8_t opcode;
-        int num_args;
+    // Precedence climbing over the lexer's tokens
+    struct ExpressionParser {
+        XenoLexer lexer;
+        XenoToken token;
+        uint16_t depth = 0;
+        bool failed = false;
+        ExpressionParser(std::string_view text, uint32_t line, uint32_t column)
+            : lexer(text, line, column), token(lexer.next()) {}
+        void advance() { token = lexer.next(); }
     };
 
-    static const FunctionInfo math_functions[];
-    static const size_t math_functions_count;
-
-    void compileMathFunction(const String& token, const FunctionInfo& func);
-    void compileSimpleCommand(const String& command, uint8_t opcode);
-
-    struct SimpleCommand {
-        const char* name;
-        uint8_t opcode;
-    };
+    friend class XenoLanguage;
 
-    static const SimpleCommand simple_commands[];
-    static const size_t simple_commands_count;
+    // Bump whenever the generated code changes so cached programs are rebuilt
+    static constexpr uint16_t CODEGEN_REVISION = 10;
 
-    friend class XenoLanguage;
+    bool validateString(std::string_view str);
+    bool validateVariableName(std::string_view name);
+    int addString(std::string_view str);
+    int getVariableIndex(std::string_view var_name);
 
-    bool validateString(const String& str);
-    bool validateVariableName(const String& name);
-    String cleanLine(const String& line);
-    int addString(const String& str);
-    int getVariableIndex(const String& var_name);
-
-    bool isFloat(const String& str);
-    bool isBool(const String& str);
-    bool isQuotedString(const String& str);
-    bool isValidVariable(const String& str);
-    bool isComparisonOperator(const String& str);
-    int getPrecedence(const String& op);
-    bool isRightAssociative(const String& op);
-    String processFunctions(const String& expr);
-    int findMatchingParenthesis(const String& expr, int start);
-    std::vector<String> infixToPostfix(const std::vector<String>& tokens);
-    std::vector<String> tokenizeExpression(const String& expr);
-    void compilePostfix(const std::vector<String>& postfix);
-    void compileExpression(const String& expr);
-    String extractVariableName(const String& text);
-    XenoDataType determineValueType(const String& value);
-    XenoValue createValueFromString(const String& str, XenoDataType type);
+    bool isBool(std::string_view str);
+    bool isQuotedString(std::string_view str);
+    bool isValidVariable(std::string_view str);
+    static int binaryPrecedence(const XenoToken& token);
+    static uint8_t binaryOpcode(std::string_view op);
+    uint32_t parseExpression(ExpressionParser& parser, int min_precedence);
+    uint32_t parseUnary(ExpressionParser& parser);
+    uint32_t parsePrimary(ExpressionParser& parser);
+    uint32_t parseCall(ExpressionParser& parser, const XenoKeywordEntry& func);
+    bool enterNesting(ExpressionParser& parser);
+    void expressionError(ExpressionParser& parser, const char* message);
+    void compileNode(uint32_t index);
+    void compileExpression(std::string_view expr);
+    std::string_view extractVariableName(std::string_view text);
+    XenoDataType determineValueType(std::string_view value);
+    XenoValue createValueFromString(std::string_view str, XenoDataType type);
     void emitInstruction(uint8_t opcode, uint32_t arg1 = 0, uint16_t arg2 = 0);
+    void emitPushNumber(const XenoValue& number);
     int getCurrentAddress();
-    void compileLine(const String& line, int line_number);
-    void processConstants(String& expr);
+    void compileLine(std::string_view line, int line_number);
+    void compileSourceLine(std::string_view line);
+    // Compiles line into fragment; false if it printed diagnostics
+    bool buildFragment(std::string_view line, int line_number, XenoLineFragment& fragment);
+    void compileFragment(std::string_view cleanedLine, int line_number, XenoLineFragment& fragment);
+    void linkFragment(const XenoLineFragment& fragment, int line_number);
+    void importModule(std::string_view statement, int line_number);
+    void linkModule(const XenoModule& module);
+    static bool isImport(std::string_view statement);
+    void appendFragmentCode(const XenoLineFragment& fragment, const std::vector<uint32_t>& strings,
+                            size_t begin, size_t end);
 
  protected:
     explicit XenoCompiler(XenoSecurityConfig& config);
     void compile(const String& source_code);
+    // Streaming: beginCompile(), compileChunk() for consecutive pieces of
+    // the source, then finishCompile(). A line may span several chunks;
+    // only the unfinished line is buffered.
+    void beginCompile();
+    void compileChunk(std::string_view chunk);
+    void finishCompile();
+    // Same program and messages as compile(), with the lines compiled on
+    // the pool's workers and linked in order afterwards. Sources with fewer
+    // than PARALLEL_MIN_LINES distinct new lines are compiled serially.
+    static constexpr size_t PARALLEL_MIN_LINES = 512;
+    void compileParallel(const String& source_code, XenoThreadPool& pool);
+
+    // import "name" lines ask the resolver for the compiled module, which
+    // reports its own errors and returns null if the module cannot be used.
+    // Without a resolver imports are rejected.
+    typedef std::function<std::shared_ptr<const XenoModule>(std::string_view name, int line_number)>
+        ModuleResolver;
+    void setModuleResolver(ModuleResolver resolver) { module_resolver = std::move(resolver); }
+    // Compiles source as a module; false if it leaves an IF or FOR open
+    bool compileModule(const String& source_code, XenoModule& module);
+    // Modules linked by the last compile; a program with imports depends on
+    // more than its own source
+    const std::vector<std::string>& getLinkedModules() const { return linked_modules; }
+    bool hasImports() const { return has_imports; }
+    // Reuse fragments of unchanged lines across compiles; nullptr disables.
+    // The cache must be cleared when the security limits change.
+    void setLineCache(XenoLineCache* cache) { line_cache = cache; }
+    // Programs are optimized once linked; modules are optimized as part of
+    // the program that imports them
+    void setOptimizationLevel(uint8_t level) { optimization_level = level; }
+    const XenoOptimizer::Stats& getOptimizerStats() const { return optimizer_stats; }
     const std::vector<XenoInstruction>& getBytecode() const;
     const std::vector<String>& getStringTable() const;
+    // Index of getStringTable(), handed to the VM together with the table
+    const XenoStringIndex& getStringIndex() const;
+    // Adopts an already compiled program, e.g. one loaded from a file, and
+    // what the optimizer did to it if that is known
+    void setProgram(std::vector<XenoInstruction> code, std::vector<String> strings,
+                    const XenoOptimizer::Stats& stats = XenoOptimizer::Stats());
     void printCompiledCode();
 };
 
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_MAIN_XENO_KEYWORDS_H_
+#define SRC_XENO_MAIN_XENO_KEYWORDS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include "../xeno_common.h"
+
+
+enum XenoKeyword : uint8_t {
+    KEYWORD_NONE,
+    // Statements
+    KEYWORD_STACK_OP,  // command that emits its opcode and nothing else
+    KEYWORD_PRINT,
+    KEYWORD_LED,
+    KEYWORD_DELAY,
+    KEYWORD_PUSH,
+    KEYWORD_INPUT,
+    KEYWORD_SET,
+    KEYWORD_IF,
+    KEYWORD_ELSE,
+    KEYWORD_ENDIF,
+    KEYWORD_FOR,
+    KEYWORD_ENDFOR,
+    KEYWORD_IMPORT,  // handled before the line is compiled
+    // Names inside expressions
+    KEYWORD_TRUE,
+    KEYWORD_FALSE,
+    KEYWORD_FUNCTION,
+    KEYWORD_CONSTANT
+};
+
+struct XenoKeywordEntry {
+    std::string_view name;
+    XenoKeyword keyword = KEYWORD_NONE;
+    uint8_t opcode = OP_NOP;
+    uint8_t num_args = 0;
+    const char* value = nullptr;  // KEYWORD_CONSTANT literal
+};
+
+// Perfect hash over a fixed keyword list, built at compile time: the seed
+// is searched until every name lands in its own slot, so a lookup is one
+// hash and one compare.
+template <size_t N, size_t SLOTS>
+class XenoKeywordTable {
+    static_assert((SLOTS & (SLOTS - 1)) == 0, "slot count must be a power of two");
+
+ public:
+    constexpr XenoKeywordTable(const XenoKeywordEntry (&list)[N], bool fold_case)
+        : entries(), slots(), seed(0), fold(fold_case) {
+        for (size_t i = 0; i < N; ++i) entries[i] = list[i];
+        for (uint32_t candidate = 1; candidate < 4096 && seed == 0; ++candidate) {
+            if (tryBuild(candidate)) seed = candidate;
+        }
+    }
+
+    constexpr bool valid() const { return seed != 0; }
+
+    constexpr const XenoKeywordEntry* find(std::string_view name) const {
+        if (name.empty()) return nullptr;
+        int16_t index = slots[hash(name, seed) & (SLOTS - 1)];
+        if (index < 0 || !equals(entries[index].name, name)) return nullptr;
+        return &entries[index];
+    }
+
+ private:
+    XenoKeywordEntry entries[N];
+    int16_t slots[SLOTS];
+    uint32_t seed;
+    bool fold;
+
+    constexpr char normalize(char c) const {
+        return (fold && c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    constexpr uint32_t hash(std::string_view name, uint32_t with_seed) const {
+        uint32_t h = 2166136261u ^ with_seed;
+        for (char c : name) {
+            h = (h ^ static_cast<uint8_t>(normalize(c))) * 16777619u;
+        }
+        return h ^ (h >> 15);
+    }
+
+    constexpr bool equals(std::string_view keyword, std::string_view name) const {
+        if (keyword.length() != name.length()) return false;
+        for (size_t i = 0; i < name.length(); ++i) {
+            if (keyword[i] != normalize(name[i])) return false;
+        }
+        return true;
+    }
+
+    constexpr bool tryBuild(uint32_t candidate) {
+        for (size_t i = 0; i < SLOTS; ++i) slots[i] = -1;
+        for (size_t i = 0; i < N; ++i) {
+            size_t slot = hash(entries[i].name, candidate) & (SLOTS - 1);
+            if (slots[slot] >= 0) return false;
+            slots[slot] = static_cast<int16_t>(i);
+        }
+        return true;
+    }
+};
+
+// Statement commands, matched case-insensitively; names are lowercase
+inline constexpr XenoKeywordEntry xeno_statement_list[] = {
+    {"pop", KEYWORD_STACK_OP, OP_POP},
+    {"add", KEYWORD_STACK_OP, OP_ADD},
+    {"sub", KEYWORD_STACK_OP, OP_SUB},
+    {"mul", KEYWORD_STACK_OP, OP_MUL},
+    {"div", KEYWORD_STACK_OP, OP_DIV},
+    {"mod", KEYWORD_STACK_OP, OP_MOD},
+    {"abs", KEYWORD_STACK_OP, OP_ABS},
+    {"pow", KEYWORD_STACK_OP, OP_POW},
+    {"max", KEYWORD_STACK_OP, OP_MAX},
+    {"min", KEYWORD_STACK_OP, OP_MIN},
+    {"sqrt", KEYWORD_STACK_OP, OP_SQRT},
+    {"printnum", KEYWORD_STACK_OP, OP_PRINT_NUM},
+    {"halt", KEYWORD_STACK_OP, OP_HALT},
+    {"print", KEYWORD_PRINT},
+    {"led", KEYWORD_LED},
+    {"delay", KEYWORD_DELAY},
+    {"push", KEYWORD_PUSH},
+    {"input", KEYWORD_INPUT},
+    {"set", KEYWORD_SET},
+    {"if", KEYWORD_IF},
+    {"else", KEYWORD_ELSE},
+    {"endif", KEYWORD_ENDIF},
+    {"for", KEYWORD_FOR},
+    {"endfor", KEYWORD_ENDFOR},
+    {"import", KEYWORD_IMPORT}
+};
+
+// Booleans, math functions and named constants, matched exactly
+inline constexpr XenoKeywordEntry xeno_expression_list[] = {
+    {"true", KEYWORD_TRUE},
+    {"false", KEYWORD_FALSE},
+    {"abs", KEYWORD_FUNCTION, OP_ABS, 1},
+    {"max", KEYWORD_FUNCTION, OP_MAX, 2},
+    {"min", KEYWORD_FUNCTION, OP_MIN, 2},
+    {"sqrt", KEYWORD_FUNCTION, OP_SQRT, 1},
+    {"sin", KEYWORD_FUNCTION, OP_SIN, 1},
+    {"cos", KEYWORD_FUNCTION, OP_COS, 1},
+    {"tan", KEYWORD_FUNCTION, OP_TAN, 1},
+    {"M_PI", KEYWORD_CONSTANT, OP_NOP, 0, "3.141592653589793"},
+    {"M_E", KEYWORD_CONSTANT, OP_NOP, 0, "2.718281828459045"},
+    {"M_TAU", KEYWORD_CONSTANT, OP_NOP, 0, "6.283185307179586"},
+    {"M_SQRT2", KEYWORD_CONSTANT, OP_NOP, 0, "1.4142135623730951"},
+    {"M_SQRT3", KEYWORD_CONSTANT, OP_NOP, 0, "1.7320508075688772"},
+    {"P_LIGHT_SPEED", KEYWORD_CONSTANT, OP_NOP, 0, "299792458"}
+};
+
+inline constexpr XenoKeywordTable<std::size(xeno_statement_list), 64>
+    xeno_statement_keywords(xeno_statement_list, true);
+inline constexpr XenoKeywordTable<std::size(xeno_expression_list), 32>
+    xeno_expression_keywords(xeno_expression_list, false);
+
+static_assert(xeno_statement_keywords.valid(), "no perfect hash seed for statement keywords");
+static_assert(xeno_expression_keywords.valid(), "no perfect hash seed for expression keywords");
+
+#endif  // SRC_XENO_MAIN_XENO_KEYWORDS_H_
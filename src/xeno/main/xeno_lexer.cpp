@@ -0,0 +1,123 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "xeno_lexer.h"
+
+XenoLexer::XenoLexer(std::string_view text, uint32_t line, uint32_t column)
+    : text(text), line_number(line), first_column(column) {}
+
+bool XenoLexer::nextLine(std::string_view& line) {
+    if (pos > text.size()) return false;
+    if (line_started) ++line_number;
+    line_started = true;
+
+    size_t end = text.find('\n', pos);
+    if (end == std::string_view::npos) end = text.size();
+    line = text.substr(pos, end - pos);
+    line_start = pos;
+    pos = end + 1;
+    return true;
+}
+
+XenoToken XenoLexer::next() {
+    while (pos < text.size() && isSpace(text[pos])) {
+        if (text[pos] == '\n') {
+            ++line_number;
+            line_start = pos + 1;
+            first_column = 1;
+        }
+        ++pos;
+    }
+    if (pos >= text.size()) return makeToken(TOKEN_END, pos, pos);
+
+    size_t start = pos;
+    char c = text[pos];
+
+    // An unterminated string runs to the end of the text
+    if (c == '"') {
+        size_t close = text.find('"', pos + 1);
+        pos = (close == std::string_view::npos) ? text.size() : close + 1;
+        return makeToken(TOKEN_STRING, start, pos);
+    }
+
+    if (atDoubleOperator(pos)) {
+        pos += 2;
+        return makeToken(TOKEN_OPERATOR, start, pos);
+    }
+
+    if (isSingleOperator(c)) {
+        ++pos;
+        XenoTokenKind kind = c == '(' ? TOKEN_LPAREN : c == ')' ? TOKEN_RPAREN : TOKEN_OPERATOR;
+        return makeToken(kind, start, pos);
+    }
+
+    if (c == ',') {
+        ++pos;
+        return makeToken(TOKEN_COMMA, start, pos);
+    }
+
+    if (!isWordChar(c)) {
+        ++pos;
+        return makeToken(TOKEN_INVALID, start, pos);
+    }
+
+    while (pos < text.size() && isWordChar(text[pos])) ++pos;
+    XenoToken token = makeToken(TOKEN_WORD, start, pos);
+    token.keyword = xeno_expression_keywords.find(token.text);
+    return token;
+}
+
+std::string_view XenoLexer::statement(std::string_view line) {
+    size_t comment = line.find("//");
+    if (comment != std::string_view::npos) line = line.substr(0, comment);
+    return trim(line);
+}
+
+std::string_view XenoLexer::trim(std::string_view text) {
+    size_t start = text.find_first_not_of(" \t\n\r\f\v");
+    if (start == std::string_view::npos) return std::string_view();
+    size_t end = text.find_last_not_of(" \t\n\r\f\v");
+    return text.substr(start, end - start + 1);
+}
+
+bool XenoLexer::isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+bool XenoLexer::isWordChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_' || c == '.';
+}
+
+bool XenoLexer::isSingleOperator(char c) {
+    return c == '+' || c == '-' || c == '*' || c == '/' || c == '%' || c == '^' ||
+           c == '<' || c == '>' || c == '(' || c == ')';
+}
+
+bool XenoLexer::atDoubleOperator(size_t at) const {
+    if (at + 1 >= text.size() || text[at + 1] != '=') return false;
+    char c = text[at];
+    return c == '=' || c == '!' || c == '<' || c == '>';
+}
+
+XenoToken XenoLexer::makeToken(XenoTokenKind kind, size_t start, size_t end) const {
+    XenoToken token;
+    token.kind = kind;
+    token.text = text.substr(start, end - start);
+    token.line = line_number;
+    token.column = first_column + static_cast<uint32_t>(start - line_start);
+    return token;
+}
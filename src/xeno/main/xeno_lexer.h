@@ -0,0 +1,77 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_MAIN_XENO_LEXER_H_
+#define SRC_XENO_MAIN_XENO_LEXER_H_
+
+#include <cstdint>
+#include <string_view>
+#include "xeno_keywords.h"
+
+
+enum XenoTokenKind : uint8_t {
+    TOKEN_END,
+    TOKEN_WORD,      // run of letters, digits, '_' and '.': numbers and names
+    TOKEN_STRING,    // quoted string, including the quotes; may be unterminated
+    TOKEN_OPERATOR,  // + - * / % ^ < > == != <= >=
+    TOKEN_LPAREN,
+    TOKEN_RPAREN,
+    TOKEN_COMMA,
+    TOKEN_INVALID    // any other character
+};
+
+struct XenoToken {
+    XenoTokenKind kind = TOKEN_END;
+    std::string_view text;
+    uint32_t line = 0;
+    uint32_t column = 0;
+    // Words naming a boolean, math function or constant
+    const XenoKeywordEntry* keyword = nullptr;
+};
+
+// Single-pass scanner producing lines and tokens as views into the scanned
+// text, which must outlive them. Nothing is copied or allocated.
+class XenoLexer {
+ public:
+    explicit XenoLexer(std::string_view text, uint32_t line = 1, uint32_t column = 1);
+
+    // Next line without its '\n'; lineNumber() is the number of that line
+    bool nextLine(std::string_view& line);
+    uint32_t lineNumber() const { return line_number; }
+
+    // Next expression token; TOKEN_END once the text is exhausted
+    XenoToken next();
+
+    // Line with its // comment and surrounding whitespace removed
+    static std::string_view statement(std::string_view line);
+    static std::string_view trim(std::string_view text);
+
+ private:
+    std::string_view text;
+    size_t pos = 0;
+    size_t line_start = 0;
+    uint32_t line_number;
+    uint32_t first_column;
+    bool line_started = false;
+
+    static bool isSpace(char c);
+    static bool isWordChar(char c);
+    static bool isSingleOperator(char c);
+    bool atDoubleOperator(size_t at) const;
+    XenoToken makeToken(XenoTokenKind kind, size_t start, size_t end) const;
+};
+
+#endif  // SRC_XENO_MAIN_XENO_LEXER_H_
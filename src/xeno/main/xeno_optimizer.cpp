@@ -0,0 +1,1692 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include "xeno_optimizer.h"
+#include "xeno_vm.h"
+#include "../security/xeno_security.h"
+
+namespace {
+
+// Each pass can expose work for the others, e.g. a variable set from a
+// folded expression or a branch that became constant; a few rounds reach
+// everything in practice
+constexpr int MAX_ROUNDS = 4;
+
+bool isJump(uint8_t opcode) {
+    return opcode == OP_JUMP || opcode == OP_JUMP_IF;
+}
+
+// A value on the abstract stack of findInvariants(): the instructions
+// [start, last] that compute it and what is known about it
+struct Expression {
+    uint32_t start;
+    uint32_t last;
+    bool invariant;
+    bool is_float;                    // always a float
+    bool no_string;                   // never a string
+    const XenoInstruction* constant;  // the push, if it is a single one
+};
+
+// Whether opcode reports an error for none of its operand values. A float
+// operand keeps ADD, SUB and POW away from the checked integer helpers,
+// but ADD also interns a new string when either operand is one. DIV by a
+// constant other than 0 and -1 cannot fail.
+bool neverFails(uint8_t opcode, const Expression& left, const Expression& right) {
+    switch (opcode) {
+        case OP_MUL:
+        case OP_MAX:
+        case OP_MIN:
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_GT:
+        case OP_LTE:
+        case OP_GTE:
+        case OP_SIN:
+        case OP_COS:
+        case OP_TAN:
+            return true;
+        case OP_ADD:
+            return (left.is_float || right.is_float) && left.no_string && right.no_string;
+        case OP_SUB:
+        case OP_POW:
+            return left.is_float || right.is_float;
+        case OP_DIV: {
+            const XenoInstruction* divisor = right.constant;
+            if (!divisor) return false;
+            if (divisor->opcode == OP_PUSH_FLOAT) {
+                float value;
+                memcpy(&value, &divisor->arg1, sizeof(float));
+                return value != 0.0f;
+            }
+            int32_t value = static_cast<int32_t>(divisor->arg1);
+            return divisor->opcode == OP_PUSH && value != 0 && value != -1;
+        }
+        default:
+            return false;
+    }
+}
+
+// What is known about the type of a value that is not a constant. Most
+// identities only hold for numbers: "x" * 1 is 0 and -0.0 + 0 is 0.0.
+enum ValueKind : uint8_t {
+    KIND_ANY,
+    KIND_NUMERIC,  // an int or a float
+    KIND_INT,
+    KIND_FLOAT
+};
+
+bool isNumeric(ValueKind kind) {
+    return kind != KIND_ANY;
+}
+
+ValueKind kindOf(const XenoValue& value) {
+    switch (value.type) {
+        case TYPE_INT: return KIND_INT;
+        case TYPE_FLOAT: return KIND_FLOAT;
+        default: return KIND_ANY;
+    }
+}
+
+// Type of the result of a binary operation on values of these kinds.
+// Arithmetic on anything but two numbers gives int 0, except ADD, which
+// joins strings.
+ValueKind resultKind(uint8_t opcode, ValueKind a, ValueKind b) {
+    switch (opcode) {
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_GT:
+        case OP_LTE:
+        case OP_GTE:
+        case OP_MOD:
+            return KIND_INT;
+        default:
+            break;
+    }
+    if (a == KIND_INT && b == KIND_INT) return KIND_INT;
+    if (isNumeric(a) && isNumeric(b)) {
+        return (a == KIND_FLOAT || b == KIND_FLOAT) ? KIND_FLOAT : KIND_NUMERIC;
+    }
+    return opcode == OP_ADD ? KIND_ANY : KIND_NUMERIC;
+}
+
+// Whether constant is n for the operation: an int n keeps ints ints and
+// floats floats, a float n only leaves floats unchanged. A float zero
+// must be +0.0, since x - -0.0 turns -0.0 into 0.0.
+bool isIdentity(const XenoValue& constant, int32_t n, ValueKind kind) {
+    if (constant.type == TYPE_INT) return constant.int_val == n && isNumeric(kind);
+    if (constant.type != TYPE_FLOAT || kind != KIND_FLOAT) return false;
+    float expected = static_cast<float>(n);
+    return memcmp(&constant.float_val, &expected, sizeof(float)) == 0;
+}
+
+// Set of the types a value may have at run time, one bit per XenoDataType
+typedef uint8_t TypeSet;
+constexpr TypeSet TYPES_INT = 1 << TYPE_INT;
+constexpr TypeSet TYPES_FLOAT = 1 << TYPE_FLOAT;
+constexpr TypeSet TYPES_STRING = 1 << TYPE_STRING;
+constexpr TypeSet TYPES_BOOL = 1 << TYPE_BOOL;
+constexpr TypeSet TYPES_ANY = TYPES_INT | TYPES_FLOAT | TYPES_STRING | TYPES_BOOL;
+
+// Type of a binary operation's result for operands of one type each
+XenoDataType resultType(uint8_t opcode, int a, int b) {
+    switch (opcode) {
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_GT:
+        case OP_LTE:
+        case OP_GTE:
+        case OP_MOD:
+            return TYPE_INT;
+        default:
+            break;
+    }
+    if (opcode == OP_ADD && (a == TYPE_STRING || b == TYPE_STRING)) return TYPE_STRING;
+    bool numeric = (a == TYPE_INT || a == TYPE_FLOAT) && (b == TYPE_INT || b == TYPE_FLOAT);
+    // Anything else gives int 0
+    if (!numeric) return TYPE_INT;
+    return (a == TYPE_FLOAT || b == TYPE_FLOAT) ? TYPE_FLOAT : TYPE_INT;
+}
+
+TypeSet resultTypes(uint8_t opcode, TypeSet a, TypeSet b) {
+    TypeSet result = 0;
+    for (int ta = TYPE_INT; ta <= TYPE_BOOL; ++ta) {
+        if (!(a & (1 << ta))) continue;
+        for (int tb = TYPE_INT; tb <= TYPE_BOOL; ++tb) {
+            if (b & (1 << tb)) result |= 1 << resultType(opcode, ta, tb);
+        }
+    }
+    return result;
+}
+
+TypeSet unaryResultTypes(uint8_t opcode, TypeSet a) {
+    if (!a) return 0;
+    switch (opcode) {
+        case OP_ABS:
+            return (a & (TYPES_INT | TYPES_FLOAT)) | ((a & (TYPES_STRING | TYPES_BOOL)) ? TYPES_INT : 0);
+        case OP_SQRT:
+            // A negative int gives int 0
+            return ((a & TYPES_INT) ? (TYPES_INT | TYPES_FLOAT) : 0) | (a & TYPES_FLOAT) |
+                   ((a & (TYPES_STRING | TYPES_BOOL)) ? TYPES_INT : 0);
+        default:
+            return TYPES_FLOAT;
+    }
+}
+
+// Opcode for two int operands, or OP_NOP if there is none
+uint8_t intVariant(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD: return OP_ADD_INT;
+        case OP_SUB: return OP_SUB_INT;
+        case OP_MUL: return OP_MUL_INT;
+        case OP_DIV: return OP_DIV_INT;
+        case OP_MOD: return OP_MOD_INT;
+        case OP_EQ: return OP_EQ_INT;
+        case OP_NEQ: return OP_NEQ_INT;
+        case OP_LT: return OP_LT_INT;
+        case OP_GT: return OP_GT_INT;
+        case OP_LTE: return OP_LTE_INT;
+        case OP_GTE: return OP_GTE_INT;
+        default: return OP_NOP;
+    }
+}
+
+// Opcode for two float operands, or OP_NOP if there is none
+uint8_t floatVariant(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD: return OP_ADD_FLOAT;
+        case OP_SUB: return OP_SUB_FLOAT;
+        case OP_MUL: return OP_MUL_FLOAT;
+        case OP_DIV: return OP_DIV_FLOAT;
+        case OP_EQ: return OP_EQ_FLOAT;
+        case OP_NEQ: return OP_NEQ_FLOAT;
+        case OP_LT: return OP_LT_FLOAT;
+        case OP_GT: return OP_GT_FLOAT;
+        case OP_LTE: return OP_LTE_FLOAT;
+        case OP_GTE: return OP_GTE_FLOAT;
+        default: return OP_NOP;
+    }
+}
+
+bool isBinaryOperation(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_MOD:
+        case OP_POW:
+        case OP_MAX:
+        case OP_MIN:
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_GT:
+        case OP_LTE:
+        case OP_GTE:
+            return true;
+        default:
+            return opcode >= OP_ADD_INT && opcode <= OP_GTE_FLOAT;
+    }
+}
+
+// Whether an operation always gives the same result for the same operands
+// and can report no error, so computing it again can be skipped. divisor
+// is the push of the right operand, if it is a single one.
+bool isPure(uint8_t opcode, const XenoInstruction* divisor) {
+    switch (opcode) {
+        case OP_MUL:
+        case OP_MAX:
+        case OP_MIN:
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_GT:
+        case OP_LTE:
+        case OP_GTE:
+        case OP_SIN:
+        case OP_COS:
+        case OP_TAN:
+        case OP_MUL_INT:
+        case OP_EQ_INT:
+        case OP_NEQ_INT:
+        case OP_LT_INT:
+        case OP_GT_INT:
+        case OP_LTE_INT:
+        case OP_GTE_INT:
+        case OP_ADD_FLOAT:
+        case OP_SUB_FLOAT:
+        case OP_MUL_FLOAT:
+        case OP_EQ_FLOAT:
+        case OP_NEQ_FLOAT:
+        case OP_LT_FLOAT:
+        case OP_GT_FLOAT:
+        case OP_LTE_FLOAT:
+        case OP_GTE_FLOAT:
+            return true;
+        case OP_DIV:
+        case OP_DIV_INT:
+        case OP_DIV_FLOAT: {
+            if (!divisor) return false;
+            float fvalue;
+            memcpy(&fvalue, &divisor->arg1, sizeof(float));
+            int32_t ivalue = static_cast<int32_t>(divisor->arg1);
+            if (divisor->opcode == OP_PUSH_FLOAT) return fvalue != 0.0f;
+            return divisor->opcode == OP_PUSH && ivalue != 0 && ivalue != -1;
+        }
+        default:
+            return false;
+    }
+}
+
+// The opcode giving the same result with the operands the other way
+// round, or OP_NOP if there is none. The generic opcodes are left out:
+// with mixed types they convert and compare differently per side.
+uint8_t mirrored(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD_INT:
+        case OP_MUL_INT:
+        case OP_EQ_INT:
+        case OP_NEQ_INT:
+        case OP_ADD_FLOAT:
+        case OP_MUL_FLOAT:
+        case OP_EQ_FLOAT:
+        case OP_NEQ_FLOAT:
+            return opcode;
+        case OP_LT_INT:    return OP_GT_INT;
+        case OP_GT_INT:    return OP_LT_INT;
+        case OP_LTE_INT:   return OP_GTE_INT;
+        case OP_GTE_INT:   return OP_LTE_INT;
+        case OP_LT_FLOAT:  return OP_GT_FLOAT;
+        case OP_GT_FLOAT:  return OP_LT_FLOAT;
+        case OP_LTE_FLOAT: return OP_GTE_FLOAT;
+        case OP_GTE_FLOAT: return OP_LTE_FLOAT;
+        default:
+            return OP_NOP;
+    }
+}
+
+bool isConstantPush(uint8_t opcode) {
+    return opcode == OP_PUSH || opcode == OP_PUSH_FLOAT ||
+           opcode == OP_PUSH_BOOL || opcode == OP_PUSH_STRING;
+}
+
+}  // namespace
+
+XenoOptimizer::Stats XenoOptimizer::run(uint8_t level) {
+    stats = Stats();
+    if (level == 0 || code.empty()) return stats;
+
+    for (int round = 0; round < MAX_ROUNDS; ++round) {
+        findJumpTargets();
+        findStores();
+        bool changed = foldConstants();
+        changed = propagateConstants() || changed;
+        changed = simplifyAlgebra() || changed;
+        changed = resolveBranches() || changed;
+        changed = threadJumps() || changed;
+        changed = removeUnreachable() || changed;
+        if (!changed) break;
+    }
+    compact();
+
+    if (level >= 2) {
+        for (int round = 0; round < MAX_ROUNDS && hoistInvariants(); ++round) {
+            compact();
+        }
+    }
+    // Last, since the other passes only know the generic opcodes
+    specializeTypes();
+    if (reuseExpressions()) compact();
+    for (int round = 0; round < MAX_ROUNDS && combineInstructions(); ++round) {
+        compact();
+    }
+    return stats;
+}
+
+void XenoOptimizer::findJumpTargets() {
+    jump_target.assign(code.size(), 0);
+    reach.resize(code.size());
+    uint32_t farthest = 0;
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        const XenoInstruction& instr = code[i];
+        reach[i] = farthest;
+        if (!isJump(instr.opcode)) continue;
+        if (instr.arg1 < code.size()) jump_target[instr.arg1] = 1;
+        if (instr.arg1 > farthest) farthest = instr.arg1;
+    }
+}
+
+void XenoOptimizer::findStores() {
+    only_store.clear();
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        const XenoInstruction& instr = code[i];
+        if (instr.opcode != OP_STORE && instr.opcode != OP_INPUT) continue;
+        if (instr.arg1 >= only_store.size()) only_store.resize(instr.arg1 + 1, NEVER_STORED);
+        uint32_t& store = only_store[instr.arg1];
+        store = (store == NEVER_STORED && instr.opcode == OP_STORE) ? i : NO_STORE;
+    }
+}
+
+bool XenoOptimizer::constantOf(const XenoInstruction& instr, XenoValue& value) {
+    switch (instr.opcode) {
+        case OP_PUSH:
+            value = XenoValue::makeInt(static_cast<int32_t>(instr.arg1));
+            return true;
+        case OP_PUSH_FLOAT: {
+            float fval;
+            memcpy(&fval, &instr.arg1, sizeof(float));
+            value = XenoValue::makeFloat(fval);
+            return true;
+        }
+        case OP_PUSH_BOOL:
+            value = XenoValue::makeBool(instr.arg1);
+            return true;
+        default:
+            return false;
+    }
+}
+
+XenoInstruction XenoOptimizer::pushOf(const XenoValue& value) {
+    switch (value.type) {
+        case TYPE_FLOAT: {
+            uint32_t fbits;
+            memcpy(&fbits, &value.float_val, sizeof(float));
+            return XenoInstruction(OP_PUSH_FLOAT, fbits);
+        }
+        case TYPE_BOOL:
+            return XenoInstruction(OP_PUSH_BOOL, value.bool_val ? 1 : 0);
+        default:
+            return XenoInstruction(OP_PUSH, static_cast<uint32_t>(value.int_val));
+    }
+}
+
+// Tracks the values pushed since the start of the basic block. An
+// operation whose operands all came from constant pushes is evaluated
+// here: its instruction becomes the push of the result and the operand
+// pushes become NOPs.
+bool XenoOptimizer::foldConstants() {
+    struct Slot {
+        bool known;
+        XenoValue value;
+        uint32_t producer;
+    };
+    std::vector<Slot> stack;
+    bool changed = false;
+
+    auto pop = [&stack](size_t count) {
+        stack.resize(stack.size() > count ? stack.size() - count : 0);
+    };
+
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        if (jump_target[i]) stack.clear();
+        XenoInstruction& instr = code[i];
+        XenoValue value;
+
+        switch (instr.opcode) {
+            case OP_NOP:
+            case OP_PRINT:
+            case OP_LED_ON:
+            case OP_LED_OFF:
+            case OP_DELAY:
+            case OP_INPUT:
+                break;
+
+            case OP_PUSH:
+            case OP_PUSH_FLOAT:
+            case OP_PUSH_BOOL:
+                constantOf(instr, value);
+                stack.push_back({true, value, i});
+                break;
+
+            case OP_PUSH_STRING:
+            case OP_LOAD:
+                stack.push_back({false, value, i});
+                break;
+
+            case OP_POP:
+            case OP_STORE:
+                pop(1);
+                break;
+
+            case OP_PRINT_NUM:
+                // The printed value has to stay on the stack
+                if (!stack.empty()) stack.back().known = false;
+                break;
+
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_MOD:
+            case OP_POW:
+            case OP_MAX:
+            case OP_MIN:
+            case OP_EQ:
+            case OP_NEQ:
+            case OP_LT:
+            case OP_GT:
+            case OP_LTE:
+            case OP_GTE: {
+                size_t size = stack.size();
+                if (size >= 2 && stack[size - 2].known && stack[size - 1].known &&
+                    XenoVM::evaluatePure(instr.opcode, stack[size - 2].value,
+                                         stack[size - 1].value, value)) {
+                    code[stack[size - 2].producer] = XenoInstruction(OP_NOP);
+                    code[stack[size - 1].producer] = XenoInstruction(OP_NOP);
+                    instr = pushOf(value);
+                    pop(2);
+                    stack.push_back({true, value, i});
+                    ++stats.folded;
+                    changed = true;
+                } else {
+                    pop(2);
+                    stack.push_back({false, value, i});
+                }
+                break;
+            }
+
+            case OP_ABS:
+            case OP_SQRT:
+            case OP_SIN:
+            case OP_COS:
+            case OP_TAN:
+                // Replaces the top of the stack; nothing happens on an empty one
+                if (stack.empty()) break;
+                if (stack.back().known &&
+                    XenoVM::evaluatePure(instr.opcode, stack.back().value, stack.back().value, value)) {
+                    code[stack.back().producer] = XenoInstruction(OP_NOP);
+                    instr = pushOf(value);
+                    stack.back() = {true, value, i};
+                    ++stats.folded;
+                    changed = true;
+                } else {
+                    stack.back().known = false;
+                }
+                break;
+
+            default:
+                // Jumps and HALT end the block
+                stack.clear();
+                break;
+        }
+    }
+    return changed;
+}
+
+// A variable stored once from a constant and never read by INPUT holds
+// that constant after the store. Loads placed after the store are replaced
+// when no jump from before the store lands after it, so every path to them
+// passes the store first.
+bool XenoOptimizer::propagateConstants() {
+    bool changed = false;
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        XenoInstruction& instr = code[i];
+        if (instr.opcode != OP_LOAD) continue;
+        if (instr.arg1 >= only_store.size()) continue;
+
+        uint32_t store = only_store[instr.arg1];
+        if (store >= i || store == 0 || reach[store] > store) continue;
+        uint32_t push = store - 1;
+        while (push > 0 && code[push].opcode == OP_NOP) --push;
+        bool entered = false;
+        for (uint32_t k = push + 1; k <= store && !entered; ++k) entered = jump_target[k];
+        if (entered) continue;
+        const XenoInstruction& value = code[push];
+        XenoValue constant;
+        if (!constantOf(value, constant) && value.opcode != OP_PUSH_STRING) continue;
+
+        instr = value;
+        ++stats.propagated;
+        changed = true;
+    }
+    return changed;
+}
+
+// Drops operations that give back their other operand unchanged: x * 1,
+// 1 * x, x / 1 and x - 0 for numbers, x ^ 1, x + 0 and 0 + x for ints.
+// None of them can overflow, so no error disappears with them. Like
+// foldConstants() this works on the values pushed in one basic block.
+bool XenoOptimizer::simplifyAlgebra() {
+    struct Slot {
+        ValueKind kind;
+        bool known;
+        XenoValue value;
+        uint32_t producer;
+    };
+    std::vector<Slot> stack;
+    bool changed = false;
+
+    auto pop = [&stack](size_t count) {
+        stack.resize(stack.size() > count ? stack.size() - count : 0);
+    };
+    auto kindAt = [&stack](size_t depth) {
+        return depth < stack.size() ? stack[stack.size() - 1 - depth].kind : KIND_ANY;
+    };
+
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        if (jump_target[i]) stack.clear();
+        XenoInstruction& instr = code[i];
+        XenoValue value;
+
+        switch (instr.opcode) {
+            case OP_NOP:
+            case OP_PRINT:
+            case OP_LED_ON:
+            case OP_LED_OFF:
+            case OP_DELAY:
+            case OP_INPUT:
+                break;
+
+            case OP_PUSH:
+            case OP_PUSH_FLOAT:
+            case OP_PUSH_BOOL:
+                constantOf(instr, value);
+                stack.push_back({kindOf(value), true, value, i});
+                break;
+
+            case OP_PUSH_STRING:
+            case OP_LOAD:
+                stack.push_back({KIND_ANY, false, value, i});
+                break;
+
+            case OP_POP:
+            case OP_STORE:
+                pop(1);
+                break;
+
+            case OP_PRINT_NUM:
+                // The printed value has to stay on the stack
+                if (!stack.empty()) stack.back().known = false;
+                break;
+
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_MOD:
+            case OP_POW:
+            case OP_MAX:
+            case OP_MIN:
+            case OP_EQ:
+            case OP_NEQ:
+            case OP_LT:
+            case OP_GT:
+            case OP_LTE:
+            case OP_GTE: {
+                size_t size = stack.size();
+                // The operand given back unchanged and the constant beside it
+                const Slot* keep = nullptr;
+                const Slot* drop = nullptr;
+                if (size >= 2) {
+                    const Slot& a = stack[size - 2];
+                    const Slot& b = stack[size - 1];
+                    switch (instr.opcode) {
+                        case OP_MUL:
+                            if (b.known && isIdentity(b.value, 1, a.kind)) {
+                                keep = &a;
+                                drop = &b;
+                            } else if (a.known && isIdentity(a.value, 1, b.kind)) {
+                                keep = &b;
+                                drop = &a;
+                            }
+                            break;
+                        case OP_ADD:
+                            if (b.known && b.value.type == TYPE_INT && b.value.int_val == 0 &&
+                                a.kind == KIND_INT) {
+                                keep = &a;
+                                drop = &b;
+                            } else if (a.known && a.value.type == TYPE_INT && a.value.int_val == 0 &&
+                                       b.kind == KIND_INT) {
+                                keep = &b;
+                                drop = &a;
+                            }
+                            break;
+                        case OP_SUB:
+                            if (b.known && isIdentity(b.value, 0, a.kind)) {
+                                keep = &a;
+                                drop = &b;
+                            }
+                            break;
+                        case OP_DIV:
+                            if (b.known && isIdentity(b.value, 1, a.kind)) {
+                                keep = &a;
+                                drop = &b;
+                            }
+                            break;
+                        case OP_POW:
+                            // Float powers are left to the math library
+                            if (b.known && a.kind == KIND_INT && isIdentity(b.value, 1, a.kind)) {
+                                keep = &a;
+                                drop = &b;
+                            }
+                            break;
+                        default:
+                            break;
+                    }
+                }
+                // Two constants are left to foldConstants()
+                if (keep && !keep->known) {
+                    code[drop->producer] = XenoInstruction(OP_NOP);
+                    instr = XenoInstruction(OP_NOP);
+                    Slot result = *keep;
+                    pop(2);
+                    stack.push_back(result);
+                    ++stats.simplified;
+                    changed = true;
+                } else {
+                    ValueKind kind = resultKind(instr.opcode, kindAt(1), kindAt(0));
+                    pop(2);
+                    stack.push_back({kind, false, value, i});
+                }
+                break;
+            }
+
+            case OP_ABS:
+            case OP_SQRT:
+            case OP_SIN:
+            case OP_COS:
+            case OP_TAN: {
+                // Replaces the top of the stack; nothing happens on an empty one
+                if (stack.empty()) break;
+                Slot& top = stack.back();
+                if (instr.opcode == OP_ABS) {
+                    if (top.kind == KIND_ANY) top.kind = KIND_NUMERIC;
+                } else if (instr.opcode == OP_SQRT) {
+                    // A negative int gives int 0
+                    top.kind = top.kind == KIND_FLOAT ? KIND_FLOAT : KIND_NUMERIC;
+                } else {
+                    top.kind = KIND_FLOAT;
+                }
+                top.known = false;
+                top.producer = i;
+                break;
+            }
+
+            default:
+                // Jumps and HALT end the block
+                stack.clear();
+                break;
+        }
+    }
+    return changed;
+}
+
+// First instruction at or after address that is not a NOP
+uint32_t XenoOptimizer::nextInstruction(uint32_t address) const {
+    while (address < code.size() && code[address].opcode == OP_NOP) ++address;
+    return address;
+}
+
+// Where control ends up after jumping to target, following unconditional
+// jumps; stops on cycles, which are infinite loops
+uint32_t XenoOptimizer::finalTarget(uint32_t target) const {
+    uint32_t current = target;
+    for (size_t steps = 0; steps < code.size(); ++steps) {
+        current = nextInstruction(current);
+        if (current >= code.size()) return target;
+        if (code[current].opcode != OP_JUMP) break;
+        current = code[current].arg1;
+    }
+    return current < code.size() ? current : target;
+}
+
+// A conditional jump on a constant pushed right before it either always
+// jumps or never does. The push must not be a place some jump lands on
+// with another value.
+bool XenoOptimizer::resolveBranches() {
+    bool changed = false;
+    for (uint32_t i = 1; i < code.size(); ++i) {
+        if (code[i].opcode != OP_JUMP_IF) continue;
+        uint32_t push = i - 1;
+        while (push > 0 && code[push].opcode == OP_NOP) --push;
+
+        XenoValue condition;
+        if (!constantOf(code[push], condition)) continue;
+        bool entered = false;
+        for (uint32_t k = push + 1; k <= i && !entered; ++k) entered = jump_target[k];
+        if (entered) continue;
+
+        bool taken = false;
+        switch (condition.type) {
+            case TYPE_INT: taken = condition.int_val != 0; break;
+            case TYPE_FLOAT: taken = condition.float_val != 0.0f; break;
+            case TYPE_BOOL: taken = condition.bool_val; break;
+            default: break;
+        }
+        code[push] = XenoInstruction(OP_NOP);
+        code[i] = taken ? XenoInstruction(OP_JUMP, code[i].arg1) : XenoInstruction(OP_NOP);
+        ++stats.branches;
+        changed = true;
+    }
+    return changed;
+}
+
+// Jumps to a jump go to its target instead, jumps to HALT become HALT and
+// jumps to the next instruction disappear. A conditional jump to the next
+// instruction still pops its condition.
+bool XenoOptimizer::threadJumps() {
+    bool changed = false;
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        XenoInstruction& instr = code[i];
+        if (!isJump(instr.opcode) || instr.arg1 >= code.size()) continue;
+
+        uint32_t target = finalTarget(instr.arg1);
+        bool falls_through = target == nextInstruction(i + 1);
+        if (instr.opcode == OP_JUMP && code[target].opcode == OP_HALT) {
+            instr = XenoInstruction(OP_HALT);
+        } else if (falls_through) {
+            instr = XenoInstruction(instr.opcode == OP_JUMP ? OP_NOP : OP_POP);
+        } else if (target != instr.arg1) {
+            instr.arg1 = target;
+        } else {
+            continue;
+        }
+        ++stats.threaded;
+        changed = true;
+    }
+    return changed;
+}
+
+// Instructions no path from the start reaches become NOPs. The final HALT
+// stays so the verifier still finds one.
+bool XenoOptimizer::removeUnreachable() {
+    std::vector<uint8_t> reached(code.size(), 0);
+    std::vector<uint32_t> pending(1, 0);
+    while (!pending.empty()) {
+        uint32_t address = pending.back();
+        pending.pop_back();
+        while (address < code.size() && !reached[address]) {
+            reached[address] = 1;
+            const XenoInstruction& instr = code[address];
+            if (instr.opcode == OP_HALT) break;
+            if (isJump(instr.opcode) && instr.arg1 < code.size()) {
+                if (instr.opcode == OP_JUMP) {
+                    address = instr.arg1;
+                    continue;
+                }
+                pending.push_back(instr.arg1);
+            } else if (instr.opcode == OP_JUMP) {
+                // Stops the VM with an error
+                break;
+            }
+            ++address;
+        }
+    }
+
+    bool changed = false;
+    for (uint32_t i = 0; i + 1 < code.size(); ++i) {
+        if (!reached[i] && code[i].opcode != OP_NOP) {
+            code[i] = XenoInstruction(OP_NOP);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// Loop-invariant code motion. FOR loops end in a jump back to their head,
+// which evaluates the end expression on every iteration. Expressions in a
+// loop that only read variables assigned before it and not written in it
+// are computed once before the head and kept in a new variable. Only
+// expressions that cannot report an error move, so the loop reports the
+// same errors even when its body never runs.
+bool XenoOptimizer::hoistInvariants() {
+    findJumpTargets();
+
+    struct Loop {
+        uint32_t head;
+        uint32_t end;
+    };
+    std::vector<Loop> loops;
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        if (code[i].opcode == OP_JUMP && code[i].arg1 <= i) loops.push_back({code[i].arg1, i});
+    }
+    // Innermost loops first; loops overlapping one that changed wait for the next round
+    std::sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) {
+        return a.end - a.head < b.end - b.head;
+    });
+
+    struct Preheader {
+        uint32_t head;
+        uint32_t end;
+        std::vector<XenoInstruction> code;
+    };
+    std::vector<Preheader> preheaders;
+    std::vector<uint8_t> claimed(code.size(), 0);
+    std::vector<std::pair<uint32_t, uint32_t>> regions;
+    size_t added = 0;
+
+    for (const Loop& loop : loops) {
+        if (std::find(claimed.begin() + loop.head, claimed.begin() + loop.end + 1, 1) !=
+            claimed.begin() + loop.end + 1) {
+            continue;
+        }
+        // Only the head may be entered from outside
+        bool single_entry = true;
+        for (uint32_t i = 0; i < code.size() && single_entry; ++i) {
+            if (i >= loop.head && i <= loop.end) continue;
+            single_entry = !isJump(code[i].opcode) || code[i].arg1 <= loop.head ||
+                           code[i].arg1 > loop.end;
+        }
+        if (!single_entry) continue;
+
+        findInvariants(loop.head, loop.end, regions);
+        if (regions.empty()) continue;
+
+        Preheader preheader{loop.head, loop.end, {}};
+        for (const auto& region : regions) {
+            size_t size = region.second - region.first + 1;
+            if (code.size() + added + preheader.code.size() + size + 1 > XenoSecurity::MAX_PROGRAM_SIZE) break;
+            int name = add_name("#" + std::to_string(temporaries));
+            if (name < 0) break;
+            ++temporaries;
+
+            preheader.code.insert(preheader.code.end(), code.begin() + region.first,
+                                  code.begin() + region.second + 1);
+            preheader.code.emplace_back(OP_STORE, name);
+            code[region.first] = XenoInstruction(OP_LOAD, name);
+            for (uint32_t i = region.first + 1; i <= region.second; ++i) code[i] = XenoInstruction(OP_NOP);
+            ++stats.hoisted;
+        }
+        if (preheader.code.empty()) continue;
+        std::fill(claimed.begin() + loop.head, claimed.begin() + loop.end + 1, 1);
+        added += preheader.code.size();
+        preheaders.push_back(std::move(preheader));
+    }
+    if (preheaders.empty()) return false;
+
+    // Preheaders go right before their loop's head. Jumps to the head from
+    // outside the loop enter through the preheader.
+    std::sort(preheaders.begin(), preheaders.end(), [](const Preheader& a, const Preheader& b) {
+        return a.head < b.head;
+    });
+    std::vector<XenoInstruction> result;
+    result.reserve(code.size() + added);
+    std::vector<uint32_t> new_address(code.size() + 1);
+    std::vector<uint32_t> entry_of(code.size(), UINT32_MAX);
+    std::vector<uint32_t> origin;
+    origin.reserve(code.size() + added);
+    size_t next = 0;
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        if (next < preheaders.size() && preheaders[next].head == i) {
+            entry_of[i] = result.size();
+            for (const XenoInstruction& instr : preheaders[next].code) {
+                result.push_back(instr);
+                origin.push_back(UINT32_MAX);
+            }
+            ++next;
+        }
+        new_address[i] = result.size();
+        result.push_back(code[i]);
+        origin.push_back(i);
+    }
+    new_address[code.size()] = result.size();
+
+    next = 0;
+    for (size_t k = 0; k < result.size(); ++k) {
+        XenoInstruction& instr = result[k];
+        if (!isJump(instr.opcode) || instr.arg1 >= code.size()) continue;
+        uint32_t target = instr.arg1;
+        uint32_t from = origin[k];
+        const Preheader* preheader = nullptr;
+        if (entry_of[target] != UINT32_MAX) {
+            auto it = std::lower_bound(preheaders.begin(), preheaders.end(), target,
+                                       [](const Preheader& p, uint32_t head) { return p.head < head; });
+            preheader = &*it;
+        }
+        bool inside = preheader && from >= preheader->head && from <= preheader->end;
+        instr.arg1 = (preheader && !inside) ? entry_of[target] : new_address[target];
+    }
+    code.swap(result);
+    return true;
+}
+
+// Maximal invariant expressions in [head, end], as address ranges that
+// push exactly one value. Expressions are tracked on an abstract stack;
+// an invariant one is recorded when something that is not invariant
+// consumes it.
+void XenoOptimizer::findInvariants(uint32_t head, uint32_t end,
+                                   std::vector<std::pair<uint32_t, uint32_t>>& regions) const {
+    regions.clear();
+
+    uint32_t names = 0;
+    for (const XenoInstruction& instr : code) {
+        if (instr.opcode == OP_LOAD || instr.opcode == OP_STORE || instr.opcode == OP_INPUT) {
+            names = std::max(names, instr.arg1 + 1);
+        }
+    }
+    // Stable in the loop: written by no instruction in it and assigned on
+    // every path to it, so loading cannot report a missing variable
+    std::vector<uint8_t> stable(names, 0);
+    for (uint32_t i = 0; i < head; ++i) {
+        const XenoInstruction& instr = code[i];
+        if ((instr.opcode == OP_STORE || instr.opcode == OP_INPUT) && reach[i] <= i) {
+            stable[instr.arg1] = 1;
+        }
+    }
+    for (uint32_t i = head; i <= end; ++i) {
+        const XenoInstruction& instr = code[i];
+        if (instr.opcode == OP_STORE || instr.opcode == OP_INPUT) stable[instr.arg1] = 0;
+    }
+
+    std::vector<Expression> stack;
+    auto release = [&stack, &regions](size_t count) {
+        for (; count > 0 && !stack.empty(); --count) {
+            const Expression& expr = stack.back();
+            if (expr.invariant && expr.last > expr.start) regions.emplace_back(expr.start, expr.last);
+            stack.pop_back();
+        }
+    };
+    auto unknown = [](uint32_t address) {
+        return Expression{address, address, false, false, false, nullptr};
+    };
+
+    for (uint32_t i = head; i <= end; ++i) {
+        if (jump_target[i] && i != head) stack.clear();
+        const XenoInstruction& instr = code[i];
+        switch (instr.opcode) {
+            case OP_PUSH:
+            case OP_PUSH_FLOAT:
+            case OP_PUSH_BOOL:
+            case OP_PUSH_STRING:
+                stack.push_back({i, i, true, instr.opcode == OP_PUSH_FLOAT,
+                                 instr.opcode != OP_PUSH_STRING, &instr});
+                break;
+
+            case OP_LOAD: {
+                Expression expr = unknown(i);
+                expr.invariant = stable[instr.arg1] != 0;
+                stack.push_back(expr);
+                break;
+            }
+
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_MOD:
+            case OP_POW:
+            case OP_MAX:
+            case OP_MIN:
+            case OP_EQ:
+            case OP_NEQ:
+            case OP_LT:
+            case OP_GT:
+            case OP_LTE:
+            case OP_GTE: {
+                size_t size = stack.size();
+                if (size >= 2) {
+                    const Expression& left = stack[size - 2];
+                    const Expression& right = stack[size - 1];
+                    if (left.invariant && right.invariant && left.last + 1 == right.start &&
+                        right.last + 1 == i && neverFails(instr.opcode, left, right)) {
+                        bool no_string = instr.opcode != OP_ADD || (left.no_string && right.no_string);
+                        Expression combined{left.start, i, true, false, no_string, nullptr};
+                        stack.resize(size - 2);
+                        stack.push_back(combined);
+                        break;
+                    }
+                }
+                release(2);
+                stack.push_back(unknown(i));
+                break;
+            }
+
+            case OP_ABS:
+            case OP_SQRT:
+            case OP_SIN:
+            case OP_COS:
+            case OP_TAN:
+                if (!stack.empty() && stack.back().invariant && stack.back().last + 1 == i &&
+                    neverFails(instr.opcode, stack.back(), stack.back())) {
+                    stack.back() = {stack.back().start, i, true, true, true, nullptr};
+                } else {
+                    release(1);
+                    stack.push_back(unknown(i));
+                }
+                break;
+
+            case OP_POP:
+            case OP_STORE:
+            case OP_JUMP_IF:
+                release(1);
+                break;
+
+            case OP_PRINT_NUM:
+                if (!stack.empty()) {
+                    uint32_t start = stack.back().start;
+                    release(1);
+                    stack.push_back(unknown(i));
+                    stack.back().start = start;
+                }
+                break;
+
+            case OP_NOP:
+            case OP_PRINT:
+            case OP_LED_ON:
+            case OP_LED_OFF:
+            case OP_DELAY:
+            case OP_INPUT:
+                break;
+
+            default:
+                stack.clear();
+                break;
+        }
+    }
+    std::sort(regions.begin(), regions.end());
+}
+
+// Flow-sensitive type inference. Every basic block gets the set of types
+// each variable and each value on the stack may have when it starts,
+// joined over all the paths to it. A variable nothing stored yet loads
+// as int 0 and INPUT may store any type. Arithmetic and comparisons whose
+// operands are then known to be both ints or both floats get the opcode
+// for those types.
+void XenoOptimizer::specializeTypes() {
+    findJumpTargets();
+
+    uint32_t names = 0;
+    for (const XenoInstruction& instr : code) {
+        if (instr.opcode == OP_LOAD || instr.opcode == OP_STORE || instr.opcode == OP_INPUT) {
+            names = std::max(names, instr.arg1 + 1);
+        }
+    }
+
+    struct Value {
+        TypeSet types;
+        uint32_t producer;  // the PUSH, while it is in the same block
+    };
+    struct State {
+        bool reached = false;
+        std::vector<TypeSet> variables;
+        std::vector<Value> stack;
+    };
+    static constexpr uint32_t NO_PRODUCER = UINT32_MAX;
+
+    std::vector<uint8_t> leader(code.size(), 0);
+    leader[0] = 1;
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        uint8_t opcode = code[i].opcode;
+        if (jump_target[i]) leader[i] = 1;
+        if ((isJump(opcode) || opcode == OP_HALT) && i + 1 < code.size()) leader[i + 1] = 1;
+    }
+
+    std::vector<State> entry(code.size());
+    entry[0].reached = true;
+    entry[0].variables.assign(names, TYPES_INT);
+
+    // Joins state into the entry of the block at address; true if it grew
+    auto join = [&entry](uint32_t address, const State& state) {
+        State& target = entry[address];
+        if (!target.reached) {
+            target = state;
+            for (Value& value : target.stack) value.producer = NO_PRODUCER;
+            return true;
+        }
+        bool grew = false;
+        for (size_t v = 0; v < target.variables.size(); ++v) {
+            TypeSet types = target.variables[v] | state.variables[v];
+            grew = grew || types != target.variables[v];
+            target.variables[v] = types;
+        }
+        // Stacks of different depth only agree on their common top
+        size_t depth = std::min(target.stack.size(), state.stack.size());
+        if (depth < target.stack.size()) {
+            target.stack.erase(target.stack.begin(), target.stack.end() - depth);
+            grew = true;
+        }
+        for (size_t k = 1; k <= depth; ++k) {
+            TypeSet& types = target.stack[target.stack.size() - k].types;
+            TypeSet joined = types | state.stack[state.stack.size() - k].types;
+            grew = grew || joined != types;
+            types = joined;
+        }
+        return grew;
+    };
+
+    // Runs the block at start from its entry state; rewrite also changes
+    // the opcodes the operand types allow. Returns the state at its end.
+    auto runBlock = [this, &leader, &entry](uint32_t start, bool rewrite, uint32_t& last) {
+        State state = entry[start];
+        auto pop = [&state]() {
+            if (state.stack.empty()) return Value{TYPES_ANY, NO_PRODUCER};
+            Value value = state.stack.back();
+            state.stack.pop_back();
+            return value;
+        };
+
+        uint32_t i = start;
+        for (;; ++i) {
+            XenoInstruction& instr = code[i];
+            switch (instr.opcode) {
+                case OP_PUSH:
+                    state.stack.push_back({TYPES_INT, i});
+                    break;
+                case OP_PUSH_FLOAT:
+                    state.stack.push_back({TYPES_FLOAT, NO_PRODUCER});
+                    break;
+                case OP_PUSH_BOOL:
+                    state.stack.push_back({TYPES_BOOL, NO_PRODUCER});
+                    break;
+                case OP_PUSH_STRING:
+                    state.stack.push_back({TYPES_STRING, NO_PRODUCER});
+                    break;
+
+                case OP_LOAD:
+                    state.stack.push_back({state.variables[instr.arg1], NO_PRODUCER});
+                    break;
+                case OP_STORE:
+                    state.variables[instr.arg1] = pop().types;
+                    break;
+                case OP_INPUT:
+                    state.variables[instr.arg1] = TYPES_ANY;
+                    break;
+
+                case OP_POP:
+                case OP_JUMP_IF:
+                    pop();
+                    break;
+
+                case OP_PRINT_NUM:
+                    // The value stays, but is no longer used only once
+                    if (!state.stack.empty()) state.stack.back().producer = NO_PRODUCER;
+                    break;
+
+                case OP_ADD:
+                case OP_SUB:
+                case OP_MUL:
+                case OP_DIV:
+                case OP_MOD:
+                case OP_POW:
+                case OP_MAX:
+                case OP_MIN:
+                case OP_EQ:
+                case OP_NEQ:
+                case OP_LT:
+                case OP_GT:
+                case OP_LTE:
+                case OP_GTE: {
+                    Value b = pop();
+                    Value a = pop();
+                    TypeSet types = resultTypes(instr.opcode, a.types, b.types);
+                    uint8_t as_int = intVariant(instr.opcode);
+                    if (!rewrite || as_int == OP_NOP) {
+                        state.stack.push_back({types, NO_PRODUCER});
+                        break;
+                    }
+                    ++stats.arithmetic;
+                    // An int constant only this operation reads may become a
+                    // float one: toFloat() gives the same value. Mixed EQ and
+                    // NEQ compare exactly, float ones with a tolerance.
+                    bool ordered = instr.opcode != OP_EQ && instr.opcode != OP_NEQ;
+                    auto floatable = [this, ordered](const Value& value) {
+                        return value.types == TYPES_FLOAT ||
+                               (ordered && value.types == TYPES_INT && value.producer != NO_PRODUCER &&
+                                code[value.producer].opcode == OP_PUSH);
+                    };
+                    uint8_t as_float = floatVariant(instr.opcode);
+                    if (a.types == TYPES_INT && b.types == TYPES_INT) {
+                        instr.opcode = as_int;
+                        ++stats.specialized;
+                    } else if (as_float != OP_NOP && floatable(a) && floatable(b) &&
+                               (a.types == TYPES_FLOAT || b.types == TYPES_FLOAT)) {
+                        for (const Value* operand : {&a, &b}) {
+                            if (operand->types == TYPES_FLOAT) continue;
+                            XenoInstruction& push = code[operand->producer];
+                            push = pushOf(XenoValue::makeFloat(static_cast<float>(
+                                static_cast<int32_t>(push.arg1))));
+                        }
+                        instr.opcode = as_float;
+                        ++stats.specialized;
+                    }
+                    state.stack.push_back({types, NO_PRODUCER});
+                    break;
+                }
+
+                case OP_ABS:
+                case OP_SQRT:
+                case OP_SIN:
+                case OP_COS:
+                case OP_TAN:
+                    // Replaces the top of the stack; nothing happens on an empty one
+                    if (!state.stack.empty()) {
+                        state.stack.back() = {unaryResultTypes(instr.opcode, state.stack.back().types),
+                                              NO_PRODUCER};
+                    }
+                    break;
+
+                case OP_NOP:
+                case OP_PRINT:
+                case OP_LED_ON:
+                case OP_LED_OFF:
+                case OP_DELAY:
+                case OP_JUMP:
+                case OP_HALT:
+                    break;
+
+                default:
+                    // Nothing is known after an opcode this pass does not model
+                    state.stack.clear();
+                    state.variables.assign(state.variables.size(), TYPES_ANY);
+                    break;
+            }
+            if (i + 1 >= code.size() || leader[i + 1]) break;
+        }
+        last = i;
+        return state;
+    };
+
+    std::vector<uint32_t> worklist{0};
+    std::vector<uint8_t> queued(code.size(), 0);
+    queued[0] = 1;
+    while (!worklist.empty()) {
+        uint32_t start = worklist.back();
+        worklist.pop_back();
+        queued[start] = 0;
+
+        uint32_t last;
+        State state = runBlock(start, false, last);
+        const XenoInstruction& instr = code[last];
+        uint32_t successors[2];
+        size_t count = 0;
+        if (isJump(instr.opcode) && instr.arg1 < code.size()) successors[count++] = instr.arg1;
+        if (instr.opcode != OP_JUMP && instr.opcode != OP_HALT && last + 1 < code.size()) {
+            successors[count++] = last + 1;
+        }
+        for (size_t k = 0; k < count; ++k) {
+            uint32_t next = successors[k];
+            if (join(next, state) && !queued[next]) {
+                queued[next] = 1;
+                worklist.push_back(next);
+            }
+        }
+    }
+
+    for (uint32_t start = 0; start < code.size(); ++start) {
+        if (!leader[start] || !entry[start].reached) continue;
+        uint32_t last;
+        runBlock(start, true, last);
+    }
+}
+
+// Local value numbering. Within a basic block every value pushed gets a
+// number; equal numbers mean equal values. LOAD numbers change with each
+// STORE or INPUT of the variable, and nothing carries over into the next
+// block. An expression computed again from pure operations is dropped:
+// - if the first result is still on top of the stack, the repeat becomes
+//   a DUP of it;
+// - if the first result was consumed, a DUP right after it keeps a copy
+//   below the values pushed meanwhile. Those must never reach below the
+//   copy, nor read it, and must all be gone where the repeat starts.
+// The repeat must not report errors the copy would hide, so LOADs only
+// take part for variables assigned on every path to them. At most one
+// copy is kept at a time, and it must fit the stack limit.
+bool XenoOptimizer::reuseExpressions() {
+    findJumpTargets();
+    std::vector<uint32_t> depths = stackDepths();
+
+    uint32_t names = 0;
+    for (const XenoInstruction& instr : code) {
+        if (instr.opcode == OP_LOAD || instr.opcode == OP_STORE || instr.opcode == OP_INPUT) {
+            names = std::max(names, instr.arg1 + 1);
+        }
+    }
+    // First assignment that every later instruction is preceded by
+    std::vector<uint32_t> assigned(names, UINT32_MAX);
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        const XenoInstruction& instr = code[i];
+        if ((instr.opcode == OP_STORE || instr.opcode == OP_INPUT) && reach[i] <= i) {
+            assigned[instr.arg1] = std::min(assigned[instr.arg1], i);
+        }
+    }
+
+    struct Value {
+        uint32_t number;
+        uint32_t start;     // [start, end] computes the value and nothing else
+        uint32_t end;
+        bool replaceable;   // from pure operations, with no copy kept elsewhere
+        uint32_t height;    // most values [start, end] has on the stack at once
+    };
+    struct Available {
+        uint32_t last;      // where the value was last pushed
+        size_t depth;       // stack depth right after that
+    };
+    typedef std::tuple<uint8_t, uint32_t, uint32_t> Key;
+    std::map<Key, uint32_t> numbers;
+    std::map<uint32_t, Available> available;
+    std::vector<uint32_t> version(names, 0);
+    std::vector<uint32_t> stored(names, UINT32_MAX);
+    std::vector<Value> stack;
+    std::vector<uint8_t> dup_after(code.size(), 0);
+    // Stack size of the block after each instruction
+    std::vector<uint32_t> heights(code.size(), 0);
+    uint32_t kept_until = 0;  // end of the last repeat a copy was kept for
+    uint32_t next_number = 0;
+    uint32_t stamp = 0;
+    uint32_t block = 0;
+    bool changed = false;
+
+    auto numberOf = [&numbers, &next_number](const Key& key) {
+        auto it = numbers.emplace(key, next_number);
+        if (it.second) ++next_number;
+        return it.first->second;
+    };
+    auto forget = [&available](auto drop) {
+        for (auto it = available.begin(); it != available.end();) {
+            it = drop(it->second) ? available.erase(it) : std::next(it);
+        }
+    };
+    // The top of the stack is read where a consumed value's copy would be
+    auto readTop = [&forget, &stack]() {
+        size_t depth = stack.size();
+        forget([depth](const Available& a) { return a.depth > depth; });
+    };
+    auto pop = [&]() {
+        if (stack.empty()) {
+            // Something from before the block: nothing below it is known
+            available.clear();
+            return Value{next_number++, 0, 0, false, 1};
+        }
+        Value value = stack.back();
+        stack.pop_back();
+        size_t depth = stack.size();
+        forget([depth](const Available& a) { return a.depth > depth + 1; });
+        return value;
+    };
+    auto opaque = [&next_number](uint32_t i) {
+        return Value{next_number++, i, i, false, 1};
+    };
+    // The copy sits under everything up to the repeat, one deeper than the
+    // program ever went there. Fine if the depth is known to stay below
+    // the limit, or if nothing rises above the copy: the repeat itself
+    // reaches that high when it takes two values.
+    auto fits = [&](const Available& copy, const Value& value) {
+        if (copy.last < kept_until) return false;
+        bool known = true;
+        for (uint32_t p = copy.last; known && p < value.start; ++p) {
+            known = depths[p] != UNKNOWN_DEPTH && depths[p] < max_stack;
+        }
+        if (known) return true;
+        if (value.height < 2) return false;
+        for (uint32_t p = copy.last + 1; p < value.start; ++p) {
+            if (heights[p] > copy.depth) return false;
+        }
+        return true;
+    };
+    // Pushes value, reusing an earlier copy if it is worth it
+    auto push = [&](Value value, bool worth) {
+        bool clean = value.replaceable && worth;
+        for (uint32_t k = value.start; clean && k <= value.end; ++k) clean = !dup_after[k];
+
+        auto found = available.find(value.number);
+        bool on_top = clean && !stack.empty() && stack.back().number == value.number;
+        // A kept copy of a lone LOAD would stop the larger expression
+        // around it from being reused
+        bool below = clean && !on_top && value.end > value.start && found != available.end() &&
+                     found->second.depth == stack.size() + 1 && fits(found->second, value);
+        if (on_top || below) {
+            for (uint32_t k = value.start; k <= value.end; ++k) code[k] = XenoInstruction(OP_NOP);
+            // Values computed inside the repeat are gone with it
+            uint32_t first = value.start;
+            if (on_top) {
+                code[value.start] = XenoInstruction(OP_DUP);
+                readTop();
+            } else {
+                // A copy for a value pushed since would sit on top of this one
+                dup_after[found->second.last] = 1;
+                first = found->second.last + 1;
+                value.replaceable = false;
+                kept_until = value.end;
+            }
+            uint32_t end = value.end;
+            forget([first, end](const Available& a) { return a.last >= first && a.last <= end; });
+            ++stats.reused;
+            changed = true;
+        }
+        stack.push_back(value);
+        if (on_top || below || clean) available[value.number] = {value.end, stack.size()};
+    };
+
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        if (jump_target[i]) {
+            stack.clear();
+            numbers.clear();
+            available.clear();
+            ++block;
+        }
+        const XenoInstruction& instr = code[i];
+        switch (instr.opcode) {
+            case OP_PUSH:
+            case OP_PUSH_FLOAT:
+            case OP_PUSH_BOOL:
+            case OP_PUSH_STRING:
+                // Pushing a constant again costs no more than a DUP
+                push({numberOf(Key(instr.opcode, instr.arg1, 0)), i, i, true, 1}, false);
+                break;
+
+            case OP_LOAD:
+                if (assigned[instr.arg1] < i || stored[instr.arg1] == block) {
+                    push({numberOf(Key(OP_LOAD, instr.arg1, version[instr.arg1])), i, i, true, 1}, true);
+                } else {
+                    // May report a missing variable every time
+                    push(opaque(i), false);
+                }
+                break;
+
+            case OP_STORE:
+            case OP_INPUT:
+                if (instr.opcode == OP_STORE) pop();
+                // Later loads see a new value
+                version[instr.arg1] = ++stamp;
+                stored[instr.arg1] = block;
+                break;
+
+            case OP_POP:
+                pop();
+                break;
+
+            case OP_JUMP_IF:
+                pop();
+                // A copy would be left behind where it jumps to
+                available.clear();
+                break;
+
+            case OP_PRINT_NUM:
+                readTop();
+                break;
+
+            case OP_NOP:
+            case OP_PRINT:
+            case OP_LED_ON:
+            case OP_LED_OFF:
+            case OP_DELAY:
+                break;
+
+            case OP_ABS:
+            case OP_SQRT:
+            case OP_SIN:
+            case OP_COS:
+            case OP_TAN: {
+                Value operand = pop();
+                if (!isPure(instr.opcode, nullptr)) {
+                    push(opaque(i), false);
+                    break;
+                }
+                bool contiguous = operand.replaceable && operand.end + 1 == i;
+                push({numberOf(Key(instr.opcode, operand.number, 0)), operand.start, i, contiguous,
+                      operand.height}, true);
+                break;
+            }
+
+            default: {
+                if (!isBinaryOperation(instr.opcode)) {
+                    // Jumps and HALT end the block
+                    stack.clear();
+                    available.clear();
+                    break;
+                }
+                Value b = pop();
+                Value a = pop();
+                const XenoInstruction* divisor =
+                    (b.replaceable && b.start == b.end) ? &code[b.start] : nullptr;
+                if (!isPure(instr.opcode, divisor)) {
+                    push(opaque(i), false);
+                    break;
+                }
+                // The operands must be computed right before it, in order
+                bool contiguous = a.replaceable && b.replaceable && a.end + 1 == b.start && b.end + 1 == i;
+                uint32_t number = numberOf(Key(instr.opcode, a.number, b.number));
+                push({number, contiguous ? a.start : i, i, contiguous,
+                      std::max(a.height, b.height + 1)}, true);
+                break;
+            }
+        }
+        heights[i] = stack.size();
+    }
+    if (!changed) return false;
+
+    std::vector<XenoInstruction> result;
+    result.reserve(code.size() + stats.reused);
+    std::vector<uint32_t> new_address(code.size() + 1);
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        new_address[i] = result.size();
+        result.push_back(code[i]);
+        if (dup_after[i]) result.emplace_back(OP_DUP);
+    }
+    new_address[code.size()] = result.size();
+    for (XenoInstruction& instr : result) {
+        if (isJump(instr.opcode) && instr.arg1 < code.size()) instr.arg1 = new_address[instr.arg1];
+    }
+    code.swap(result);
+    return true;
+}
+
+// Peephole pass over windows of two or three instructions:
+//   STORE x; LOAD x             -> STORE_KEEP x
+//   DUP; STORE x                -> STORE_KEEP x
+//   STORE_KEEP x; POP           -> STORE x
+//   STORE x; push; LOAD x       -> STORE_KEEP x; push; SWAP
+//   SWAP; op                    -> op with its operands mirrored
+//   SWAP; SWAP, PUSH; POP, DUP; POP dropped
+// where push is a constant or a LOAD of another variable. Nothing may
+// jump into a window, and STORE_KEEP needs its value pushed after the
+// last jump target, as the verifier checks.
+bool XenoOptimizer::combineInstructions() {
+    findJumpTargets();
+    std::vector<uint32_t> depths = XenoSecurity::knownStackDepths(code);
+    bool changed = false;
+
+    for (uint32_t i = 0; i + 1 < code.size(); ++i) {
+        XenoInstruction& first = code[i];
+        XenoInstruction& second = code[i + 1];
+        if (jump_target[i + 1]) continue;
+        bool keep = first.opcode == OP_STORE && depths[i] >= 1;
+
+        uint32_t last = i + 1;
+        if (keep && second.opcode == OP_LOAD && second.arg1 == first.arg1) {
+            first.opcode = OP_STORE_KEEP;
+            second = XenoInstruction(OP_NOP);
+        } else if (first.opcode == OP_DUP && second.opcode == OP_STORE) {
+            first = XenoInstruction(OP_STORE_KEEP, second.arg1);
+            second = XenoInstruction(OP_NOP);
+        } else if (first.opcode == OP_STORE_KEEP && second.opcode == OP_POP) {
+            first.opcode = OP_STORE;
+            second = XenoInstruction(OP_NOP);
+        } else if (((isConstantPush(first.opcode) || first.opcode == OP_DUP) && second.opcode == OP_POP) ||
+                   (first.opcode == OP_SWAP && second.opcode == OP_SWAP)) {
+            first = XenoInstruction(OP_NOP);
+            second = XenoInstruction(OP_NOP);
+        } else if (first.opcode == OP_SWAP && mirrored(second.opcode) != OP_NOP) {
+            second.opcode = mirrored(second.opcode);
+            first = XenoInstruction(OP_NOP);
+        } else if (keep && i + 2 < code.size() && !jump_target[i + 2] &&
+                   (isConstantPush(second.opcode) ||
+                    (second.opcode == OP_LOAD && second.arg1 != first.arg1)) &&
+                   code[i + 2].opcode == OP_LOAD && code[i + 2].arg1 == first.arg1) {
+            // A stack swap instead of a second lookup by name
+            first.opcode = OP_STORE_KEEP;
+            code[i + 2] = XenoInstruction(OP_SWAP);
+            last = i + 2;
+        } else {
+            continue;
+        }
+        ++stats.combined;
+        changed = true;
+        i = last;
+    }
+    return changed;
+}
+
+// Stack depth after each instruction, the same on every path from the
+// start, or UNKNOWN_DEPTH where paths disagree or none gets there
+std::vector<uint32_t> XenoOptimizer::stackDepths() const {
+    constexpr uint32_t NOT_REACHED = UNKNOWN_DEPTH - 1;
+    std::vector<uint32_t> before(code.size(), NOT_REACHED);
+    std::vector<uint32_t> work;
+    auto reachWith = [&](uint32_t target, uint32_t depth) {
+        if (target >= code.size() || before[target] == depth || before[target] == UNKNOWN_DEPTH) return;
+        before[target] = before[target] == NOT_REACHED ? depth : UNKNOWN_DEPTH;
+        work.push_back(target);
+    };
+    auto after = [&](uint32_t i) {
+        if (before[i] == NOT_REACHED || before[i] == UNKNOWN_DEPTH) return UNKNOWN_DEPTH;
+        uint32_t pops, pushes;
+        XenoSecurity::stackEffect(code[i].opcode, pops, pushes);
+        return (before[i] > pops ? before[i] - pops : 0) + pushes;
+    };
+
+    reachWith(0, 0);
+    while (!work.empty()) {
+        uint32_t i = work.back();
+        work.pop_back();
+        const XenoInstruction& instr = code[i];
+        uint32_t depth = after(i);
+        if (isJump(instr.opcode)) reachWith(instr.arg1, depth);
+        if (instr.opcode != OP_JUMP && instr.opcode != OP_HALT) reachWith(i + 1, depth);
+    }
+
+    std::vector<uint32_t> depths(code.size());
+    for (uint32_t i = 0; i < code.size(); ++i) depths[i] = after(i);
+    return depths;
+}
+
+// Drops NOPs and moves jump targets to the instruction that followed them
+void XenoOptimizer::compact() {
+    std::vector<uint32_t> new_address(code.size() + 1);
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < code.size(); ++i) {
+        new_address[i] = kept;
+        if (code[i].opcode != OP_NOP) code[kept++] = code[i];
+    }
+    new_address[code.size()] = kept;
+
+    for (uint32_t i = 0; i < kept; ++i) {
+        XenoInstruction& instr = code[i];
+        if (isJump(instr.opcode) && instr.arg1 < new_address.size()) {
+            instr.arg1 = new_address[instr.arg1];
+        }
+    }
+    stats.removed += code.size() - kept;
+    code.resize(kept);
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_MAIN_XENO_OPTIMIZER_H_
+#define SRC_XENO_MAIN_XENO_OPTIMIZER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "../xeno_common.h"
+
+
+// Rewrites a linked program so it does less work at run time. Output and
+// run-time errors stay the same; only the instructions executed change.
+class XenoOptimizer {
+ public:
+    // 0 = off, 1 = constant folding and propagation, algebraic identities,
+    // jump threading, dead code removal, int/float opcodes where types are
+    // known, reuse of repeated expressions and a peephole pass over
+    // store/load pairs, 2 = also hoists loop invariants into variables
+    // named "#0", "#1", ...
+    static constexpr uint8_t MAX_LEVEL = 2;
+    static constexpr uint8_t DEFAULT_LEVEL = 1;
+
+    struct Stats {
+        size_t folded = 0;      // operations computed at compile time
+        size_t propagated = 0;  // loads replaced by the constant stored
+        size_t simplified = 0;  // operations that left their operand unchanged
+        size_t branches = 0;    // conditional jumps with a known outcome
+        size_t threaded = 0;    // jumps sent straight to their final target
+        size_t hoisted = 0;     // loop-invariant expressions computed before the loop
+        size_t reused = 0;      // repeated expressions replaced by a copy of the first
+        size_t combined = 0;    // short sequences rewritten by the peephole pass
+        size_t removed = 0;     // instructions dropped from the program
+        size_t arithmetic = 0;  // arithmetic and comparisons left in the program
+        size_t specialized = 0; // of those, the ones given an int or float opcode
+    };
+
+    // Interns the name of a variable the optimizer introduces and returns
+    // its string index, or -1 if the program cannot take another string
+    typedef std::function<int(std::string_view name)> NameAllocator;
+
+    // max_stack_size is the VM stack limit the program will run under
+    XenoOptimizer(std::vector<XenoInstruction>& program, NameAllocator allocator,
+                  uint32_t max_stack_size)
+        : code(program), add_name(std::move(allocator)), max_stack(max_stack_size) {}
+    Stats run(uint8_t level);
+
+ private:
+    std::vector<XenoInstruction>& code;
+    NameAllocator add_name;
+    uint32_t max_stack;
+    uint32_t temporaries = 0;
+    // Nonzero for instructions a jump lands on
+    std::vector<uint8_t> jump_target;
+    // Farthest target of the jumps before each instruction
+    std::vector<uint32_t> reach;
+    // By variable name index: address of its only STORE, or one of these
+    static constexpr uint32_t NEVER_STORED = UINT32_MAX - 1;
+    static constexpr uint32_t NO_STORE = UINT32_MAX;  // stored again or read by INPUT
+    static constexpr uint32_t UNKNOWN_DEPTH = UINT32_MAX;
+    std::vector<uint32_t> only_store;
+    Stats stats;
+
+    // Recomputed every round; only hoistInvariants() and compact() move
+    // instructions
+    void findJumpTargets();
+    void findStores();
+    bool foldConstants();
+    bool propagateConstants();
+    bool simplifyAlgebra();
+    bool resolveBranches();
+    bool threadJumps();
+    bool removeUnreachable();
+    bool hoistInvariants();
+    void findInvariants(uint32_t head, uint32_t end,
+                        std::vector<std::pair<uint32_t, uint32_t>>& regions) const;
+    void specializeTypes();
+    bool reuseExpressions();
+    std::vector<uint32_t> stackDepths() const;
+    bool combineInstructions();
+    void compact();
+    uint32_t nextInstruction(uint32_t address) const;
+    uint32_t finalTarget(uint32_t target) const;
+    static bool constantOf(const XenoInstruction& instr, XenoValue& value);
+    static XenoInstruction pushOf(const XenoValue& value);
+};
+
+#endif  // SRC_XENO_MAIN_XENO_OPTIMIZER_H_
@@ -17,6 +17,7 @@
 #include <algorithm>
 #include <limits>
 #include <vector>
+#include <utility>
 #include "xeno_vm.h"
 #include "../debug/xeno_debug_tools.h"
 #define String XenoString
@@ -33,6 +34,8 @@ void XenoVM::initializeDispatchTable() {
     dispatch_table[OP_DELAY] = &XenoVM::handleDELAY;
     dispatch_table[OP_PUSH] = &XenoVM::handlePUSH;
     dispatch_table[OP_POP] = &XenoVM::handlePOP;
+    dispatch_table[OP_DUP] = &XenoVM::handleDUP;
+    dispatch_table[OP_SWAP] = &XenoVM::handleSWAP;
     dispatch_table[OP_ADD] = &XenoVM::handleBINARY_OP;
     dispatch_table[OP_SUB] = &XenoVM::handleBINARY_OP;
     dispatch_table[OP_MUL] = &XenoVM::handleBINARY_OP;
@@ -45,6 +48,7 @@ void XenoVM::initializeDispatchTable() {
     dispatch_table[OP_JUMP_IF] = &XenoVM::handleJUMP_IF;
     dispatch_table[OP_PRINT_NUM] = &XenoVM::handlePRINT_NUM;
     dispatch_table[OP_STORE] = &XenoVM::handleSTORE;
+    dispatch_table[OP_STORE_KEEP] = &XenoVM::handleSTORE_KEEP;
     dispatch_table[OP_LOAD] = &XenoVM::handleLOAD;
     dispatch_table[OP_ABS] = &XenoVM::handleUNARY_MATH;
     dispatch_table[OP_SQRT] = &XenoVM::handleUNARY_MATH;
@@ -61,6 +65,12 @@ void XenoVM::initializeDispatchTable() {
     dispatch_table[OP_PUSH_FLOAT] = &XenoVM::handlePUSH_FLOAT;
     dispatch_table[OP_PUSH_STRING] = &XenoVM::handlePUSH_STRING;
     dispatch_table[OP_PUSH_BOOL] = &XenoVM::handlePUSH_BOOL;
+    for (int op = OP_ADD_INT; op <= OP_GTE_INT; op++) {
+        dispatch_table[op] = &XenoVM::handleINT_OP;
+    }
+    for (int op = OP_ADD_FLOAT; op <= OP_GTE_FLOAT; op++) {
+        dispatch_table[op] = &XenoVM::handleFLOAT_OP;
+    }
     dispatch_table[OP_HALT] = &XenoVM::handleHALT;
 }
 
@@ -70,9 +80,18 @@ void XenoVM::resetState() {
     running = false;
     instruction_count = 0;
     iteration_count = 0;
+    cooperative = false;
+    yield_reason = YIELD_QUANTUM;
+    wake_time = 0;
+    input_pending = false;
+    pending_input_index = 0;
+    input_deadline = 0;
+    base_string_count = 0;
+    snapshot_requested = false;
+    next_snapshot_at = snapshot_interval ? snapshot_interval : UINT32_MAX;
     max_instructions = security_config.getCurrentMaxInstructions();
-    variables.clear();
-    string_lookup.clear();
+    variables.reset();
+    string_lookup.reset();
 }
 
 String XenoVM::convertToString(const XenoValue& val) {
@@ -82,7 +101,7 @@ String XenoVM::convertToString(const XenoValue& val) {
         case TYPE_FLOAT:
             return String(val.float_val, 3);
         case TYPE_STRING:
-            return string_table[val.string_index];
+            return (*string_table)[val.string_index];
         case TYPE_BOOL:
             return val.bool_val ? "true" : "false";
         default:
@@ -189,7 +208,13 @@ bool XenoVM::Pow(int32_t base, int32_t exponent, int32_t& result) {
         result = 0;
         return true;
     }
+    // These never overflow, however many factors there are
+    if (base == 1 || base == -1) {
+        result = (base == -1 && exponent % 2) ? -1 : 1;
+        return true;
+    }
 
+    // Any other base overflows within 32 factors
     result = 1;
     for (int32_t i = 0; i < exponent; ++i) {
         if (!Mul(result, base, result)) {
@@ -407,6 +432,26 @@ XenoValue XenoVM::performAbs(const XenoValue& a) {
 }
 
 bool XenoVM::performComparison(const XenoValue& a, const XenoValue& b, uint8_t op) {
+    if (a.type != TYPE_STRING || b.type != TYPE_STRING) {
+        return compareValues(a, b, op);
+    }
+
+    const String& str_a = (*string_table)[a.string_index];
+    const String& str_b = (*string_table)[b.string_index];
+    int comparison = str_a.compareTo(str_b);
+
+    switch (op) {
+        case OP_EQ:  return comparison == 0;
+        case OP_NEQ: return comparison != 0;
+        case OP_LT:  return comparison < 0;
+        case OP_GT:  return comparison > 0;
+        case OP_LTE: return comparison <= 0;
+        case OP_GTE: return comparison >= 0;
+        default:     return false;
+    }
+}
+
+bool XenoVM::compareValues(const XenoValue& a, const XenoValue& b, uint8_t op) {
     if (a.type != b.type) {
         if (bothNumeric(a, b)) {
             float a_val = toFloat(a);
@@ -454,23 +499,6 @@ bool XenoVM::performComparison(const XenoValue& a, const XenoValue& b, uint8_t o
             }
             break;
 
-        case TYPE_STRING: {
-            const String& str_a = string_table[a.string_index];
-            const String& str_b = string_table[b.string_index];
-            int comparison = str_a.compareTo(str_b);
-
-            switch (op) {
-                case OP_EQ:  return comparison == 0;
-                case OP_NEQ: return comparison != 0;
-                case OP_LT:  return comparison < 0;
-                case OP_GT:  return comparison > 0;
-                case OP_LTE: return comparison <= 0;
-                case OP_GTE: return comparison >= 0;
-                default:     return false;
-            }
-            break;
-        }
-
         case TYPE_BOOL:
             switch (op) {
                 case OP_EQ:  return a.bool_val == b.bool_val;
@@ -488,51 +516,168 @@ bool XenoVM::performComparison(const XenoValue& a, const XenoValue& b, uint8_t o
     }
 }
 
-uint16_t XenoVM::addString(const String& str) {
-    String safe_str = security.sanitizeString(str);
+bool XenoVM::evaluatePure(uint8_t opcode, const XenoValue& a, const XenoValue& b, XenoValue& result) {
+    if (a.type == TYPE_STRING || b.type == TYPE_STRING) return false;
+
+    switch (opcode) {
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_GT:
+        case OP_LTE:
+        case OP_GTE:
+            result = XenoValue::makeInt(compareValues(a, b, opcode) ? 0 : 1);
+            return true;
+
+        case OP_ABS:
+        case OP_SQRT:
+        case OP_SIN:
+        case OP_COS:
+        case OP_TAN:
+            if (a.type == TYPE_INT) {
+                if (opcode == OP_ABS) {
+                    if (a.int_val == std::numeric_limits<int32_t>::min()) return false;
+                    result = XenoValue::makeInt(abs(a.int_val));
+                    return true;
+                }
+                if (opcode == OP_SQRT) {
+                    if (a.int_val < 0) return false;
+                    result = XenoValue::makeFloat(sqrt(static_cast<float>(a.int_val)));
+                    return true;
+                }
+            } else if (a.type == TYPE_FLOAT) {
+                if (opcode == OP_ABS) {
+                    result = XenoValue::makeFloat(fabs(a.float_val));
+                    return true;
+                }
+                if (opcode == OP_SQRT) {
+                    if (a.float_val < 0) return false;
+                    result = XenoValue::makeFloat(sqrt(a.float_val));
+                    return true;
+                }
+            } else {
+                return false;
+            }
+            switch (opcode) {
+                case OP_SIN: result = XenoValue::makeFloat(sin(toFloat(a))); return true;
+                case OP_COS: result = XenoValue::makeFloat(cos(toFloat(a))); return true;
+                case OP_TAN: result = XenoValue::makeFloat(tan(toFloat(a))); return true;
+            }
+            return false;
+
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_POW:
+        case OP_MAX:
+        case OP_MIN:
+            break;
+
+        case OP_MOD:
+            if (a.type != TYPE_INT || b.type != TYPE_INT || b.int_val == 0) return false;
+            if (a.int_val == std::numeric_limits<int32_t>::min() && b.int_val == -1) {
+                result = XenoValue::makeInt(0);
+            } else {
+                result = XenoValue::makeInt(a.int_val % b.int_val);
+            }
+            return true;
+
+        default:
+            return false;
+    }
 
-    auto it = string_lookup.find(safe_str);
-    if (it != string_lookup.end()) {
-        return it->second;
+    if (!bothNumeric(a, b)) {
+        result = XenoValue::makeInt(0);
+        return true;
     }
 
-    for (size_t i = 0; i < string_table.size(); ++i) {
-        if (string_table[i] == safe_str) {
-            string_lookup[safe_str] = i;
-            return i;
+    if (a.type == TYPE_FLOAT || b.type == TYPE_FLOAT) {
+        float a_val = toFloat(a);
+        float b_val = toFloat(b);
+        switch (opcode) {
+            case OP_ADD: result = XenoValue::makeFloat(a_val + b_val); break;
+            case OP_SUB: result = XenoValue::makeFloat(a_val - b_val); break;
+            case OP_MUL: result = XenoValue::makeFloat(a_val * b_val); break;
+            case OP_DIV:
+                if (b_val == 0.0f) return false;
+                result = XenoValue::makeFloat(a_val / b_val);
+                break;
+            case OP_POW: result = XenoValue::makeFloat(pow(a_val, b_val)); break;
+            case OP_MAX: result = XenoValue::makeFloat(max(a_val, b_val)); break;
+            case OP_MIN: result = XenoValue::makeFloat(min(a_val, b_val)); break;
         }
+        return true;
     }
 
-    if (string_table.size() >= 65535) {
+    // Integer results the checked helpers would reject are left to run
+    // time, which reports them
+    int64_t wide;
+    int32_t value;
+    switch (opcode) {
+        case OP_ADD:
+        case OP_SUB:
+            wide = opcode == OP_ADD ? static_cast<int64_t>(a.int_val) + b.int_val
+                                    : static_cast<int64_t>(a.int_val) - b.int_val;
+            if (wide < std::numeric_limits<int32_t>::min() ||
+                wide > std::numeric_limits<int32_t>::max()) {
+                return false;
+            }
+            value = static_cast<int32_t>(wide);
+            break;
+        case OP_MUL:
+            if (!Mul(a.int_val, b.int_val, value)) return false;
+            break;
+        case OP_DIV:
+            if (b.int_val == 0) return false;
+            if (a.int_val == std::numeric_limits<int32_t>::min() && b.int_val == -1) return false;
+            value = a.int_val / b.int_val;
+            break;
+        case OP_POW:
+            if (b.int_val < 0) return false;
+            if (b.int_val == 0 || a.int_val == 1) {
+                value = 1;
+            } else if (a.int_val == 0) {
+                value = 0;
+            } else if (a.int_val == -1) {
+                value = (b.int_val % 2) ? -1 : 1;
+            } else {
+                // Any other base overflows within 32 factors
+                value = 1;
+                for (int32_t i = 0; i < b.int_val; ++i) {
+                    if (!Mul(value, a.int_val, value)) return false;
+                }
+            }
+            break;
+        case OP_MAX: value = max(a.int_val, b.int_val); break;
+        case OP_MIN: value = min(a.int_val, b.int_val); break;
+        default: return false;
+    }
+    result = XenoValue::makeInt(value);
+    return true;
+}
+
+uint16_t XenoVM::addString(const String& str) {
+    String safe_str = security.sanitizeString(str);
+
+    int existing = string_lookup->find(*string_table, safe_str.view());
+    if (existing >= 0) {
+        return existing;
+    }
+
+    if (string_table->size() >= 65535) {
         Serial.println("ERROR: String table overflow");
         return 0;
     }
 
-    string_table.push_back(safe_str);
-    uint16_t new_index = string_table.size() - 1;
-    string_lookup[safe_str] = new_index;
+    string_table.write().push_back(safe_str);
+    uint16_t new_index = string_table->size() - 1;
+    string_lookup.write().insert(*string_table, new_index);
     return new_index;
 }
 
 
 
-bool XenoVM::isFloat(const String& str) {
-    if (str.isEmpty()) return false;
-    const char* cstr = str.c_str();
-    bool has_decimal = false;
-    size_t start = 0;
-    if (cstr[0] == '-') start = 1;
-    for (size_t i = start; i < str.length(); ++i) {
-        if (cstr[i] == '.') {
-            if (has_decimal) return false;
-            has_decimal = true;
-        } else if (!isdigit(cstr[i])) {
-            return false;
-        }
-    }
-    return has_decimal;
-}
-
 bool XenoVM::isBool(const String& str) {
     return str == "true" || str == "false";
 }
@@ -540,8 +685,8 @@ bool XenoVM::isBool(const String& str) {
 void XenoVM::handleNOP(const XenoInstruction& instr) { /* Do nothing */ }
 
 void XenoVM::handlePRINT(const XenoInstruction& instr) {
-    if (instr.arg1 < string_table.size()) {
-        Serial.println(string_table[instr.arg1]);
+    if (instr.arg1 < string_table->size()) {
+        Serial.println((*string_table)[instr.arg1]);
     } else {
         Serial.println("ERROR: Invalid string index");
     }
@@ -572,6 +717,11 @@ void XenoVM::handleLED_OFF(const XenoInstruction& instr) {
 }
 
 void XenoVM::handleDELAY(const XenoInstruction& instr) {
+    if (cooperative) {
+        wake_time = io.millis() + instr.arg1;
+        yield_reason = YIELD_SLEEP;
+        return;
+    }
     delay(instr.arg1);
 }
 
@@ -611,6 +761,19 @@ void XenoVM::handlePOP(const XenoInstruction& instr) {
     if (!Pop(temp)) return;
 }
 
+void XenoVM::handleDUP(const XenoInstruction& instr) {
+    XenoValue top;
+    if (!Peek(top)) return;
+    if (!Push(top)) return;
+}
+
+void XenoVM::handleSWAP(const XenoInstruction& instr) {
+    XenoValue a, b;
+    if (!PopTwo(a, b)) return;
+    stack[stack_pointer++] = b;
+    stack[stack_pointer++] = a;
+}
+
 void XenoVM::handleBINARY_OP(const XenoInstruction& instr) {
     XenoValue a, b;
     if (!PopTwo(a, b)) return;
@@ -649,6 +812,89 @@ void XenoVM::handleBINARY_OP(const XenoInstruction& instr) {
     if (!Push(result)) return;
 }
 
+// Both operands are ints; same results and errors as the generic opcodes
+void XenoVM::handleINT_OP(const XenoInstruction& instr) {
+    XenoValue a, b;
+    if (!PopTwo(a, b)) return;
+
+    int32_t result = 0;
+    switch (instr.opcode) {
+        case OP_ADD_INT:
+            if (!Add(a.int_val, b.int_val, result)) result = 0;
+            break;
+        case OP_SUB_INT:
+            if (!Sub(a.int_val, b.int_val, result)) result = 0;
+            break;
+        case OP_MUL_INT:
+            if (!Mul(a.int_val, b.int_val, result)) result = 0;
+            break;
+        case OP_DIV_INT:
+            if (b.int_val == 0) {
+                Serial.println("ERROR: Division by zero");
+            } else if (a.int_val == std::numeric_limits<int32_t>::min() && b.int_val == -1) {
+                Serial.println("ERROR: Integer overflow in division");
+            } else {
+                result = a.int_val / b.int_val;
+            }
+            break;
+        case OP_MOD_INT:
+            if (!Mod(a.int_val, b.int_val, result)) result = 0;
+            break;
+        // Comparisons push 0 when they hold
+        case OP_EQ_INT:  result = a.int_val == b.int_val ? 0 : 1; break;
+        case OP_NEQ_INT: result = a.int_val != b.int_val ? 0 : 1; break;
+        case OP_LT_INT:  result = a.int_val < b.int_val ? 0 : 1; break;
+        case OP_GT_INT:  result = a.int_val > b.int_val ? 0 : 1; break;
+        case OP_LTE_INT: result = a.int_val <= b.int_val ? 0 : 1; break;
+        case OP_GTE_INT: result = a.int_val >= b.int_val ? 0 : 1; break;
+        default:
+            return;
+    }
+
+    if (!Push(XenoValue::makeInt(result))) return;
+}
+
+// Both operands are floats; same results and errors as the generic opcodes
+void XenoVM::handleFLOAT_OP(const XenoInstruction& instr) {
+    XenoValue a, b;
+    if (!PopTwo(a, b)) return;
+
+    XenoValue result;
+    switch (instr.opcode) {
+        case OP_ADD_FLOAT:
+            result = XenoValue::makeFloat(a.float_val + b.float_val);
+            break;
+        case OP_SUB_FLOAT:
+            result = XenoValue::makeFloat(a.float_val - b.float_val);
+            break;
+        case OP_MUL_FLOAT:
+            result = XenoValue::makeFloat(a.float_val * b.float_val);
+            break;
+        case OP_DIV_FLOAT:
+            if (b.float_val != 0.0f) {
+                result = XenoValue::makeFloat(a.float_val / b.float_val);
+            } else {
+                Serial.println("ERROR: Division by zero");
+                result = XenoValue::makeFloat(0.0f);
+            }
+            break;
+        case OP_EQ_FLOAT:
+            result = XenoValue::makeInt(fabs(a.float_val - b.float_val) < 0.0001f ? 0 : 1);
+            break;
+        case OP_NEQ_FLOAT:
+            result = XenoValue::makeInt(fabs(a.float_val - b.float_val) >= 0.0001f ? 0 : 1);
+            break;
+        case OP_LT_FLOAT:  result = XenoValue::makeInt(a.float_val < b.float_val ? 0 : 1); break;
+        case OP_GT_FLOAT:  result = XenoValue::makeInt(a.float_val > b.float_val ? 0 : 1); break;
+        case OP_LTE_FLOAT: result = XenoValue::makeInt(a.float_val <= b.float_val ? 0 : 1); break;
+        case OP_GTE_FLOAT: result = XenoValue::makeInt(a.float_val >= b.float_val ? 0 : 1); break;
+        default:
+            return;
+    }
+
+    if (!Push(result)) return;
+}
+
 void XenoVM::handleUNARY_MATH(const XenoInstruction& instr) {
     XenoValue a;
     if (!Peek(a)) return;
@@ -679,39 +925,62 @@ void XenoVM::handleUNARY_MATH(const XenoInstruction& instr) {
 }
 
 void XenoVM::handleINPUT(const XenoInstruction& instr) {
-    if (instr.arg1 >= string_table.size()) {
+    if (instr.arg1 >= string_table->size()) {
         Serial.println("ERROR: Invalid variable name index in INPUT");
         running = false;
         return;
     }
-    String var_name = string_table[instr.arg1];
+    String var_name = (*string_table)[instr.arg1];
     Serial.print("INPUT ");
     Serial.print(var_name);
     Serial.println(":");
     const unsigned long TIMEOUT_MS = 30000;
-    XenoString raw = Serial.readStringTimeout(TIMEOUT_MS);
+
+    if (cooperative) {
+        input_pending = true;
+        pending_input_index = instr.arg1;
+        input_deadline = io.millis() + TIMEOUT_MS;
+        if (!completePendingInput()) {
+            wake_time = input_deadline;
+            yield_reason = YIELD_INPUT;
+        }
+        return;
+    }
+
+    storeInput(var_name, Serial.readStringTimeout(TIMEOUT_MS));
+}
+
+bool XenoVM::completePendingInput() {
+    std::string line;
+    if (!io.tryReadLine(line) && io.millis() < input_deadline) {
+        return false;
+    }
+    input_pending = false;
+    storeInput((*string_table)[pending_input_index], line);
+    return true;
+}
+
+void XenoVM::storeInput(const String& var_name, const String& raw) {
     String input_str = raw;
     input_str.trim();
 
     if (input_str.isEmpty()) {
         Serial.println("TIMEOUT - using default value 0");
-        variables[var_name] = XenoValue::makeInt(0);
+        variables.write()[var_name] = XenoValue::makeInt(0);
         return;
     }
     XenoString temp = input_str;
     temp.trim();
     XenoString lowered = temp.toLower();
     XenoValue input_value;
-    if (isInteger(temp)) {
-        input_value = XenoValue::makeInt(temp.toInt());
-    } else if (isFloat(temp)) {
-        input_value = XenoValue::makeFloat(temp.toFloat());
-    } else if (lowered == "true" || lowered == "false") {
-        input_value = XenoValue::makeBool(lowered == "true");
-    } else {
-        input_value = XenoValue::makeString(addString(temp));
+    if (!XenoValue::parseNumber(temp, input_value)) {
+        if (lowered == "true" || lowered == "false") {
+            input_value = XenoValue::makeBool(lowered == "true");
+        } else {
+            input_value = XenoValue::makeString(addString(temp));
+        }
     }
-    variables[var_name] = input_value;
+    variables.write()[var_name] = input_value;
     Serial.print("-> ");
     Serial.println(input_str);
 }
@@ -737,32 +1006,44 @@ void XenoVM::handlePRINT_NUM(const XenoInstruction& instr) {
     switch (val.type) {
         case TYPE_INT: Serial.println(val.int_val); break;
         case TYPE_FLOAT: Serial.println(val.float_val, 2); break;
-        case TYPE_STRING: Serial.println(string_table[val.string_index]); break;
+        case TYPE_STRING: Serial.println((*string_table)[val.string_index]); break;
         case TYPE_BOOL: Serial.println(val.bool_val ? "true" : "false"); break;
     }
 }
 
 void XenoVM::handleSTORE(const XenoInstruction& instr) {
-    if (instr.arg1 >= string_table.size()) {
+    if (instr.arg1 >= string_table->size()) {
         Serial.println("ERROR: Invalid variable name index in STORE");
         running = false;
         return;
     }
     XenoValue value;
     if (!Pop(value)) return;
-    String var_name = string_table[instr.arg1];
-    variables[var_name] = value;
+    String var_name = (*string_table)[instr.arg1];
+    variables.write()[var_name] = value;
+}
+
+void XenoVM::handleSTORE_KEEP(const XenoInstruction& instr) {
+    if (instr.arg1 >= string_table->size()) {
+        Serial.println("ERROR: Invalid variable name index in STORE_KEEP");
+        running = false;
+        return;
+    }
+    XenoValue value;
+    if (!Peek(value)) return;
+    String var_name = (*string_table)[instr.arg1];
+    variables.write()[var_name] = value;
 }
 
 void XenoVM::handleLOAD(const XenoInstruction& instr) {
-    if (instr.arg1 >= string_table.size()) {
+    if (instr.arg1 >= string_table->size()) {
         Serial.println("ERROR: Invalid variable name index in LOAD");
         running = false;
         return;
     }
-    String var_name = string_table[instr.arg1];
-    auto it = variables.find(var_name);
-    if (it != variables.end()) {
+    String var_name = (*string_table)[instr.arg1];
+    auto it = variables->find(var_name);
+    if (it != variables->end()) {
         if (!Push(it->second)) return;
     } else {
         Serial.print("ERROR: Variable not found: ");
@@ -772,7 +1053,7 @@ void XenoVM::handleLOAD(const XenoInstruction& instr) {
 }
 
 void XenoVM::handleJUMP(const XenoInstruction& instr) {
-    if (instr.arg1 < program.size()) {
+    if (instr.arg1 < program->size()) {
         program_counter = instr.arg1;
     } else {
         Serial.println("ERROR: Jump to invalid address");
@@ -789,11 +1070,11 @@ void XenoVM::handleJUMP_IF(const XenoInstruction& instr) {
     switch (condition_val.type) {
         case TYPE_INT: condition = (condition_val.int_val != 0); break;
         case TYPE_FLOAT: condition = (condition_val.float_val != 0.0f); break;
-        case TYPE_STRING: condition = !string_table[condition_val.string_index].isEmpty(); break;
+        case TYPE_STRING: condition = !(*string_table)[condition_val.string_index].isEmpty(); break;
         case TYPE_BOOL: condition = condition_val.bool_val; break;
     }
 
-    if (condition && instr.arg1 < program.size()) {
+    if (condition && instr.arg1 < program->size()) {
         program_counter = instr.arg1;
     }
 }
@@ -802,17 +1083,20 @@ void XenoVM::handleHALT(const XenoInstruction& instr) {
     running = false;
 }
 
-XenoVM::XenoVM(XenoSecurityConfig& config)
-    : security_config(config),
+XenoVM::XenoVM(XenoSecurityConfig& config, XenoIOContext& io_context)
+    : max_stack_size(config.getMaxStackSize()),
       security(config),
-      max_stack_size(config.getMaxStackSize()) {
+      security_config(config),
+      io(io_context),
+      snapshot_requested(false),
+      snapshot_interval(0) {
     initializeDispatchTable();
 
     stack = new XenoValue[max_stack_size];
 
     resetState();
-    program.reserve(128);
-    string_table.reserve(32);
+    program.write().reserve(128);
+    string_table.write().reserve(32);
 }
 
 // Деструктор
@@ -836,44 +1120,62 @@ void XenoVM::setMaxInstructions(uint32_t max_instr) {
 }
 
 void XenoVM::loadProgram(const std::vector<XenoInstruction>& bytecode,
-                        const std::vector<String>& strings, bool less_output) {
+                        const std::vector<String>& strings, bool less_output,
+                        bool verified, const XenoStringIndex* index) {
     resetState();
 
     std::vector<String> sanitized_strings;
     sanitized_strings.reserve(strings.size());
+    bool unchanged = true;
     for (const String& str : strings) {
         sanitized_strings.push_back(security.sanitizeString(str));
+        unchanged = unchanged && sanitized_strings.back() == str;
     }
 
-    if (!security.verifyBytecode(bytecode, sanitized_strings)) {
+    if (!verified && !security.verifyBytecode(bytecode, sanitized_strings)) {
         Serial.println("SECURITY: Bytecode verification failed - refusing to load");
         running = false;
         return;
     }
 
-    program = bytecode;
-    string_table = sanitized_strings;
+    program.reset(bytecode);
+    string_table.reset(std::move(sanitized_strings));
 
-    for (size_t i = 0; i < string_table.size(); ++i) {
-        string_lookup[string_table[i]] = i;
+    // The index only records positions, so it still fits when sanitizing
+    // left every string as it was
+    if (index && unchanged) {
+        string_lookup.reset(*index);
+    } else {
+        string_lookup.write().rebuild(*string_table);
     }
+    base_string_count = string_table->size();
 
     running = true;
     if (!less_output) Serial.println("\nProgram loaded and verified successfully");
 }
 
 bool XenoVM::step() {
-    if (!running || program_counter >= program.size()) {
+    XenoIOScope io_scope(io);
+    return executeStep();
+}
+
+bool XenoVM::executeStep() {
+    if (!running || program_counter >= program->size()) {
         return false;
     }
 
+    if (instruction_count >= next_snapshot_at ||
+        snapshot_requested.load(std::memory_order_acquire)) {
+        deliverSnapshot();
+    }
+
     if (++iteration_count > MAX_ITERATIONS) {
         Serial.println("ERROR: Iteration limit exceeded - possible infinite loop");
         running = false;
         return false;
     }
 
-    const XenoInstruction& instr = program[program_counter++];
+    const XenoInstruction& instr = (*program)[program_counter++];
 
     InstructionHandler handler = dispatch_table[instr.opcode];
     if (handler != nullptr) {
@@ -896,16 +1198,101 @@ bool XenoVM::step() {
 }
 
 void XenoVM::run(bool less_output) {
+    XenoIOScope io_scope(io);
     if (!less_output) Serial.println("\nStarting Xeno VM...");
     Serial.println();
 
-    while (step()) {
+    while (executeStep()) {
         // Continue execution
     }
     Serial.println();
     if (!less_output) Serial.println("Xeno VM finished");
 }
 
+XenoYieldReason XenoVM::runSlice(uint32_t fuel) {
+    XenoIOScope io_scope(io);
+    if (input_pending && running && !completePendingInput()) {
+        return YIELD_INPUT;
+    }
+
+    cooperative = true;
+    yield_reason = YIELD_QUANTUM;
+    while (fuel-- > 0) {
+        if (!executeStep()) {
+            cooperative = false;
+            return YIELD_HALT;
+        }
+        if (yield_reason != YIELD_QUANTUM) break;
+    }
+    cooperative = false;
+    return yield_reason;
+}
+
+unsigned long XenoVM::getWakeTime() const { return wake_time; }
+
+bool XenoVM::runTo(uint32_t pc) {
+    XenoIOScope io_scope(io);
+    while (running && program_counter != pc) {
+        if (!executeStep()) break;
+    }
+    return running && program_counter == pc;
+}
+
+std::shared_ptr<const XenoVMSnapshot> XenoVM::takeSnapshot() const {
+    std::shared_ptr<XenoVMSnapshot> snapshot = std::make_shared<XenoVMSnapshot>();
+    snapshot->program = program;
+    snapshot->string_table = string_table;
+    snapshot->string_lookup = string_lookup;
+    snapshot->variables = variables;
+    snapshot->stack.assign(stack, stack + stack_pointer);
+    snapshot->base_string_count = base_string_count;
+    snapshot->program_counter = program_counter;
+    snapshot->instruction_count = instruction_count;
+    snapshot->iteration_count = iteration_count;
+    return snapshot;
+}
+
+bool XenoVM::restoreSnapshot(const XenoVMSnapshot& snapshot) {
+    resetState();
+    if (snapshot.stack.size() > max_stack_size) {
+        Serial.println("ERROR: Snapshot stack does not fit the configured stack size");
+        return false;
+    }
+
+    program = snapshot.program;
+    string_table = snapshot.string_table;
+    string_lookup = snapshot.string_lookup;
+    variables = snapshot.variables;
+    std::copy(snapshot.stack.begin(), snapshot.stack.end(), stack);
+    stack_pointer = snapshot.stack.size();
+    base_string_count = snapshot.base_string_count;
+    program_counter = snapshot.program_counter;
+    instruction_count = snapshot.instruction_count;
+    iteration_count = snapshot.iteration_count;
+    running = program_counter < program->size();
+    if (snapshot_interval) next_snapshot_at = instruction_count + snapshot_interval;
+    return running;
+}
+
+void XenoVM::setSnapshotHandler(SnapshotHandler handler) {
+    snapshot_handler = std::move(handler);
+}
+
+void XenoVM::requestSnapshot() {
+    snapshot_requested.store(true, std::memory_order_release);
+}
+
+void XenoVM::setSnapshotInterval(uint32_t instructions) {
+    snapshot_interval = instructions;
+    next_snapshot_at = instructions ? instruction_count + instructions : UINT32_MAX;
+}
+
+void XenoVM::deliverSnapshot() {
+    snapshot_requested.store(false, std::memory_order_relaxed);
+    next_snapshot_at = snapshot_interval ? instruction_count + snapshot_interval : UINT32_MAX;
+    if (snapshot_handler) snapshot_handler(takeSnapshot());
+}
+
 void XenoVM::stop() {
     running = false;
     program_counter = 0;
@@ -946,7 +1333,7 @@ void XenoVM::dumpState() {
                 break;
             case TYPE_STRING:
                 type_str = "STRING";
-                value_str = "\"" + string_table[stack[i].string_index] + "\"";
+                value_str = "\"" + (*string_table)[stack[i].string_index] + "\"";
                 break;
             case TYPE_BOOL:
                 type_str = "BOOL";
@@ -964,7 +1351,7 @@ void XenoVM::dumpState() {
     Serial.println("]");
 
     Serial.println("Variables: {");
-    for (const auto& var : variables) {
+    for (const auto& var : *variables) {
         String type_str;
         String value_str;
         switch (var.second.type) {
@@ -978,7 +1365,7 @@ void XenoVM::dumpState() {
                 break;
             case TYPE_STRING:
                 type_str = "STRING";
-                value_str = "\"" + string_table[var.second.string_index] + "\"";
+                value_str = "\"" + (*string_table)[var.second.string_index] + "\"";
                 break;
             case TYPE_BOOL:
                 type_str = "BOOL";
@@ -997,6 +1384,6 @@ void XenoVM::dumpState() {
 }
 
 void XenoVM::disassemble() {
-    Debugger::disassemble(program, string_table, "Disassembly");
+    Debugger::disassemble(*program, *string_table, "Disassembly");
 }
 #undef String
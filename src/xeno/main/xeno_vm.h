@@ -20,6 +20,9 @@
 #include <vector>
 #include <map>
 #include <stack>
+#include <memory>
+#include <atomic>
+#include <functional>
 #include "../xeno_common.h"
 #include "../security/xeno_security.h"
 #include "../security/xeno_security_config.h"
@@ -27,18 +30,34 @@
 #define String XenoString
 
 
+// Frozen VM state. Clones restored from it share the program, strings and
+// variables until they first modify them.
+struct XenoVMSnapshot {
+    XenoCow<std::vector<XenoInstruction>> program;
+    XenoCow<std::vector<String>> string_table;
+    XenoCow<XenoStringIndex> string_lookup;
+    XenoCow<std::map<String, XenoValue>> variables;
+    std::vector<XenoValue> stack;
+    // Strings 0..base_string_count-1 come from the program, the rest were created at run time
+    uint32_t base_string_count = 0;
+    uint32_t program_counter = 0;
+    uint32_t instruction_count = 0;
+    uint32_t iteration_count = 0;
+};
+
 class XenoVM {
  private:
-    std::vector<XenoInstruction> program;
-    std::vector<String> string_table;
-    std::map<String, uint16_t> string_lookup;
+    XenoCow<std::vector<XenoInstruction>> program;
+    XenoCow<std::vector<String>> string_table;
+    XenoCow<XenoStringIndex> string_lookup;
+    uint32_t base_string_count;
     uint32_t program_counter;
 
     XenoValue* stack;
     uint32_t stack_pointer;
     const uint32_t max_stack_size;
 
-    std::map<String, XenoValue> variables;
+    XenoCow<std::map<String, XenoValue>> variables;
     bool running;
     uint32_t instruction_count;
     uint32_t max_instructions;
@@ -46,6 +65,22 @@ class XenoVM {
     static const uint32_t MAX_ITERATIONS = 100000;
     XenoSecurity security;
     XenoSecurityConfig& security_config;
+    XenoIOContext& io;
+
+    // Cooperative (sliced) execution state
+    bool cooperative;
+    XenoYieldReason yield_reason;
+    unsigned long wake_time;
+    bool input_pending;
+    uint32_t pending_input_index;
+    unsigned long input_deadline;
+
+    // Snapshots handed out between instructions, on request or every interval
+    typedef std::function<void(std::shared_ptr<const XenoVMSnapshot>)> SnapshotHandler;
+    SnapshotHandler snapshot_handler;
+    std::atomic<bool> snapshot_requested;
+    uint32_t snapshot_interval;
+    uint32_t next_snapshot_at;
 
     friend class XenoLanguage;
 
@@ -54,22 +89,26 @@ class XenoVM {
 
     void initializeDispatchTable();
     void resetState();
+    bool executeStep();
+    bool completePendingInput();
+    void deliverSnapshot();
+    void storeInput(const String& var_name, const String& raw);
     String convertToString(const XenoValue& val);
-    float toFloat(const XenoValue& v);
+    static float toFloat(const XenoValue& v);
     bool Push(const XenoValue& value);
     bool Pop(XenoValue& value);
     bool PopTwo(XenoValue& a, XenoValue& b);
     bool Peek(XenoValue& value);
     bool Add(int32_t a, int32_t b, int32_t& result);
     bool Sub(int32_t a, int32_t b, int32_t& result);
-    bool Mul(int32_t a, int32_t b, int32_t& result);
+    static bool Mul(int32_t a, int32_t b, int32_t& result);
     bool Pow(int32_t base, int32_t exponent, int32_t& result);
     bool Mod(int32_t a, int32_t b, int32_t& result);
     XenoValue Sqrt(const XenoValue& a);
     XenoValue Max(const XenoValue& a, const XenoValue& b);
     XenoValue Min(const XenoValue& a, const XenoValue& b);
     XenoValue convertToFloat(const XenoValue& val);
-    bool bothNumeric(const XenoValue& a, const XenoValue& b);
+    static bool bothNumeric(const XenoValue& a, const XenoValue& b);
     XenoValue performAddition(const XenoValue& a, const XenoValue& b);
     XenoValue performSubtraction(const XenoValue& a, const XenoValue& b);
     XenoValue performMultiplication(const XenoValue& a, const XenoValue& b);
@@ -78,9 +117,10 @@ class XenoVM {
     XenoValue performPower(const XenoValue& a, const XenoValue& b);
     XenoValue performAbs(const XenoValue& a);
     bool performComparison(const XenoValue& a, const XenoValue& b, uint8_t op);
+    // Comparison of two values that are not both strings
+    static bool compareValues(const XenoValue& a, const XenoValue& b, uint8_t op);
     uint16_t addString(const String& str);
 
-    bool isFloat(const String& str);
     bool isBool(const String& str);
     void handleNOP(const XenoInstruction& instr);
     void handlePRINT(const XenoInstruction& instr);
@@ -92,6 +132,8 @@ class XenoVM {
     void handlePUSH_BOOL(const XenoInstruction& instr);
     void handlePUSH_STRING(const XenoInstruction& instr);
     void handlePOP(const XenoInstruction& instr);
+    void handleDUP(const XenoInstruction& instr);
+    void handleSWAP(const XenoInstruction& instr);
     void handleINPUT(const XenoInstruction& instr);
     void handleEQ(const XenoInstruction& instr);
     void handleNEQ(const XenoInstruction& instr);
@@ -101,23 +143,42 @@ class XenoVM {
     void handleGTE(const XenoInstruction& instr);
     void handlePRINT_NUM(const XenoInstruction& instr);
     void handleSTORE(const XenoInstruction& instr);
+    void handleSTORE_KEEP(const XenoInstruction& instr);
     void handleLOAD(const XenoInstruction& instr);
     void handleJUMP(const XenoInstruction& instr);
     void handleJUMP_IF(const XenoInstruction& instr);
     void handleUNARY_MATH(const XenoInstruction& instr);
     void handleHALT(const XenoInstruction& instr);
     void handleBINARY_OP(const XenoInstruction& instr);
+    void handleINT_OP(const XenoInstruction& instr);
+    void handleFLOAT_OP(const XenoInstruction& instr);
     void handleComparisonOp(const XenoInstruction& instr, uint8_t op);
     void handlePushOp(const XenoInstruction& instr, XenoDataType type);
 
  protected:
-    explicit XenoVM(XenoSecurityConfig& config);
+    XenoVM(XenoSecurityConfig& config, XenoIOContext& io_context);
     ~XenoVM();
     void setMaxInstructions(uint32_t max_instr);
+    // verified skips bytecode verification for programs already checked
+    // under the current security limits. index, if given, indexes strings
+    // and is adopted instead of being rebuilt.
     void loadProgram(const std::vector<XenoInstruction>& bytecode,
-                    const std::vector<String>& strings, bool less_output = true);
+                    const std::vector<String>& strings, bool less_output = true,
+                    bool verified = false, const XenoStringIndex* index = nullptr);
     bool step();
     void run(bool less_output = true);
+    // Executes at most fuel instructions; DELAY and INPUT yield instead of blocking
+    XenoYieldReason runSlice(uint32_t fuel);
+    unsigned long getWakeTime() const;
+    // Executes until the next instruction is at pc; false if the program stopped first
+    bool runTo(uint32_t pc);
+    std::shared_ptr<const XenoVMSnapshot> takeSnapshot() const;
+    bool restoreSnapshot(const XenoVMSnapshot& snapshot);
+    void setSnapshotHandler(SnapshotHandler handler);
+    // Safe to call from another thread while the VM runs
+    void requestSnapshot();
+    // 0 disables periodic snapshots
+    void setSnapshotInterval(uint32_t instructions);
     void stop();
     bool isRunning() const;
     uint32_t getPC() const;
@@ -126,6 +187,13 @@ class XenoVM {
     uint32_t getIterationCount() const;
     void dumpState();
     void disassemble();
+
+ public:
+    // Result of an arithmetic, comparison or math opcode on a and b (b is
+    // ignored by unary opcodes), computed exactly as the VM would. False
+    // where the VM would report an error or the operands are strings,
+    // which need the run-time string table.
+    static bool evaluatePure(uint8_t opcode, const XenoValue& a, const XenoValue& b, XenoValue& result);
 };
 
 #undef String
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <utility>
+#include "xeno_binary_io.h"
+#define String XenoString
+
+uint64_t xenoHash64(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void XenoByteWriter::writeU8(uint8_t value) {
+    buffer.push_back(static_cast<char>(value));
+}
+
+void XenoByteWriter::writeU16(uint16_t value) {
+    writeU8(static_cast<uint8_t>(value));
+    writeU8(static_cast<uint8_t>(value >> 8));
+}
+
+void XenoByteWriter::writeU32(uint32_t value) {
+    writeU16(static_cast<uint16_t>(value));
+    writeU16(static_cast<uint16_t>(value >> 16));
+}
+
+void XenoByteWriter::writeU64(uint64_t value) {
+    writeU32(static_cast<uint32_t>(value));
+    writeU32(static_cast<uint32_t>(value >> 32));
+}
+
+void XenoByteWriter::writeBytes(const void* data, size_t size) {
+    buffer.append(static_cast<const char*>(data), size);
+}
+
+void XenoByteWriter::writeString(const char* data, size_t size) {
+    writeU32(static_cast<uint32_t>(size));
+    writeBytes(data, size);
+}
+
+void XenoByteWriter::patchU32(size_t offset, uint32_t value) {
+    for (size_t i = 0; i < 4 && offset + i < buffer.size(); ++i) {
+        buffer[offset + i] = static_cast<char>(value >> (8 * i));
+    }
+}
+
+XenoByteReader::XenoByteReader(const void* bytes, size_t length)
+    : data(static_cast<const uint8_t*>(bytes)), size(bytes ? length : 0) {}
+
+bool XenoByteReader::require(size_t count) {
+    if (failed || count > size - offset) {
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+uint8_t XenoByteReader::readU8() {
+    if (!require(1)) return 0;
+    return data[offset++];
+}
+
+uint16_t XenoByteReader::readU16() {
+    uint16_t low = readU8();
+    return static_cast<uint16_t>(low | (readU8() << 8));
+}
+
+uint32_t XenoByteReader::readU32() {
+    uint32_t low = readU16();
+    return low | (static_cast<uint32_t>(readU16()) << 16);
+}
+
+uint64_t XenoByteReader::readU64() {
+    uint64_t low = readU32();
+    return low | (static_cast<uint64_t>(readU32()) << 32);
+}
+
+const uint8_t* XenoByteReader::readBytes(size_t count) {
+    if (!require(count)) return nullptr;
+    const uint8_t* start = data + offset;
+    offset += count;
+    return start;
+}
+
+bool XenoByteReader::readString(std::string& out) {
+    uint32_t length = readU32();
+    const uint8_t* bytes = readBytes(length);
+    if (!bytes) return false;
+    out.assign(reinterpret_cast<const char*>(bytes), length);
+    return true;
+}
+
+void XenoByteReader::seek(size_t position) {
+    if (position > size) {
+        failed = true;
+        return;
+    }
+    offset = position;
+}
+#undef String
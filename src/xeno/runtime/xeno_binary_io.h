@@ -0,0 +1,79 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_RUNTIME_XENO_BINARY_IO_H_
+#define SRC_XENO_RUNTIME_XENO_BINARY_IO_H_
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "arduino_compat.h"
+#define String XenoString
+
+
+// FNV-1a over a byte range; chain calls by passing the previous result as seed
+uint64_t xenoHash64(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+// Appends little-endian fields to a byte buffer
+class XenoByteWriter {
+ private:
+    std::string buffer;
+
+ public:
+    void writeU8(uint8_t value);
+    void writeU16(uint16_t value);
+    void writeU32(uint32_t value);
+    void writeU64(uint64_t value);
+    void writeBytes(const void* data, size_t size);
+    // u32 length followed by the bytes
+    void writeString(const char* data, size_t size);
+
+    void patchU32(size_t offset, uint32_t value);
+    size_t size() const { return buffer.size(); }
+    const std::string& data() const { return buffer; }
+    std::string take() { return std::move(buffer); }
+};
+
+// Reads little-endian fields from a byte range without copying it. Any read
+// past the end sets the failed flag and returns zeros from then on.
+class XenoByteReader {
+ private:
+    const uint8_t* data;
+    size_t size;
+    size_t offset = 0;
+    bool failed = false;
+
+    bool require(size_t count);
+
+ public:
+    XenoByteReader(const void* bytes, size_t length);
+
+    uint8_t readU8();
+    uint16_t readU16();
+    uint32_t readU32();
+    uint64_t readU64();
+    // Returns a pointer into the underlying range
+    const uint8_t* readBytes(size_t count);
+    bool readString(std::string& out);
+
+    void seek(size_t position);
+    size_t position() const { return offset; }
+    size_t remaining() const { return failed ? 0 : size - offset; }
+    bool ok() const { return !failed; }
+};
+
+#undef String
+#endif  // SRC_XENO_RUNTIME_XENO_BINARY_IO_H_
@@ -0,0 +1,210 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include "xeno_bytecode_file.h"
+#include "xeno_binary_io.h"
+#include "xeno_mapped_file.h"
+#define String XenoString
+
+namespace {
+
+const size_t HEADER_SIZE = 32;
+const size_t DIRECTORY_ENTRY_SIZE = 16;
+const size_t INSTRUCTION_SIZE = 8;
+
+void alignTo8(XenoByteWriter& out) {
+    while (out.size() % 8 != 0) out.writeU8(0);
+}
+
+struct Section {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t count;
+};
+
+}  // namespace
+
+std::string XenoBytecodeFile::serialize(const std::vector<XenoInstruction>& bytecode,
+                                        const std::vector<String>& strings) {
+    const uint32_t section_count = 2;
+    XenoByteWriter out;
+
+    out.writeU32(MAGIC);
+    out.writeU16(VERSION);
+    out.writeU16(HEADER_SIZE);
+    out.writeU32(section_count);
+    out.writeU32(0);
+    out.writeU64(0);  // checksum, patched below
+    out.writeU32(0);  // file size, patched below
+    out.writeU32(0);
+
+    size_t directory = out.size();
+    for (uint32_t i = 0; i < section_count * DIRECTORY_ENTRY_SIZE; ++i) out.writeU8(0);
+    alignTo8(out);
+
+    size_t code_offset = out.size();
+    for (const XenoInstruction& instr : bytecode) {
+        out.writeU8(instr.opcode);
+        out.writeU8(0);
+        out.writeU16(instr.arg2);
+        out.writeU32(instr.arg1);
+    }
+    size_t code_size = out.size() - code_offset;
+    alignTo8(out);
+
+    size_t strings_offset = out.size();
+    uint32_t text_offset = 0;
+    for (const String& str : strings) {
+        out.writeU32(text_offset);
+        out.writeU32(str.length());
+        text_offset += str.length();
+    }
+    for (const String& str : strings) {
+        out.writeBytes(str.c_str(), str.length());
+    }
+    size_t strings_size = out.size() - strings_offset;
+    alignTo8(out);
+
+    const Section sections[] = {
+        {SECTION_CODE, static_cast<uint32_t>(code_offset), static_cast<uint32_t>(code_size),
+         static_cast<uint32_t>(bytecode.size())},
+        {SECTION_STRINGS, static_cast<uint32_t>(strings_offset), static_cast<uint32_t>(strings_size),
+         static_cast<uint32_t>(strings.size())}
+    };
+    for (uint32_t i = 0; i < section_count; ++i) {
+        size_t entry = directory + i * DIRECTORY_ENTRY_SIZE;
+        out.patchU32(entry, sections[i].type);
+        out.patchU32(entry + 4, sections[i].offset);
+        out.patchU32(entry + 8, sections[i].size);
+        out.patchU32(entry + 12, sections[i].count);
+    }
+    out.patchU32(24, out.size());
+
+    uint64_t checksum = xenoHash64(out.data().data() + HEADER_SIZE, out.size() - HEADER_SIZE);
+    out.patchU32(16, static_cast<uint32_t>(checksum));
+    out.patchU32(20, static_cast<uint32_t>(checksum >> 32));
+    return out.take();
+}
+
+bool XenoBytecodeFile::deserialize(const uint8_t* data, size_t size,
+                                   std::vector<XenoInstruction>& bytecode,
+                                   std::vector<String>& strings) {
+    XenoByteReader header(data, size);
+    uint32_t magic = header.readU32();
+    uint16_t version = header.readU16();
+    uint16_t header_size = header.readU16();
+    uint32_t section_count = header.readU32();
+    header.readU32();
+    uint64_t checksum = header.readU64();
+    uint32_t file_size = header.readU32();
+    header.readU32();
+
+    if (!header.ok() || magic != MAGIC) {
+        Serial.println("ERROR: Not a Xeno bytecode file");
+        return false;
+    }
+    if (version != VERSION || header_size != HEADER_SIZE) {
+        Serial.println("ERROR: Unsupported bytecode file version");
+        return false;
+    }
+    if (file_size != size || xenoHash64(data + HEADER_SIZE, size - HEADER_SIZE) != checksum) {
+        Serial.println("ERROR: Bytecode file checksum mismatch");
+        return false;
+    }
+    if (section_count > (size - HEADER_SIZE) / DIRECTORY_ENTRY_SIZE) {
+        Serial.println("ERROR: Bytecode file is corrupt");
+        return false;
+    }
+
+    bool have_code = false;
+    bool have_strings = false;
+    for (uint32_t i = 0; i < section_count; ++i) {
+        Section section;
+        section.type = header.readU32();
+        section.offset = header.readU32();
+        section.size = header.readU32();
+        section.count = header.readU32();
+        if (section.offset > size || section.size > size - section.offset) {
+            Serial.println("ERROR: Bytecode section out of bounds");
+            return false;
+        }
+
+        if (section.type == SECTION_CODE) {
+            if (section.size != section.count * INSTRUCTION_SIZE) {
+                Serial.println("ERROR: Bytecode code section is corrupt");
+                return false;
+            }
+            XenoByteReader in(data + section.offset, section.size);
+            bytecode.clear();
+            bytecode.reserve(section.count);
+            for (uint32_t j = 0; j < section.count; ++j) {
+                uint8_t opcode = in.readU8();
+                in.readU8();
+                uint16_t arg2 = in.readU16();
+                uint32_t arg1 = in.readU32();
+                bytecode.emplace_back(opcode, arg1, arg2);
+            }
+            have_code = true;
+        } else if (section.type == SECTION_STRINGS) {
+            if (section.count > section.size / 8) {
+                Serial.println("ERROR: Bytecode string section is corrupt");
+                return false;
+            }
+            const uint8_t* text = data + section.offset + section.count * 8;
+            size_t text_size = section.size - section.count * 8;
+            XenoByteReader in(data + section.offset, section.count * 8);
+            strings.clear();
+            strings.reserve(section.count);
+            for (uint32_t j = 0; j < section.count; ++j) {
+                uint32_t offset = in.readU32();
+                uint32_t length = in.readU32();
+                if (offset > text_size || length > text_size - offset) {
+                    Serial.println("ERROR: Bytecode string out of bounds");
+                    return false;
+                }
+                strings.push_back(String(std::string(reinterpret_cast<const char*>(text + offset), length)));
+            }
+            have_strings = true;
+        }
+    }
+
+    if (!have_code || !have_strings) {
+        Serial.println("ERROR: Bytecode file is missing a section");
+        return false;
+    }
+    return true;
+}
+
+bool XenoBytecodeFile::save(const std::string& path, const std::vector<XenoInstruction>& bytecode,
+                            const std::vector<String>& strings) {
+    std::string bytes = serialize(bytecode, strings);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    return static_cast<bool>(file.write(bytes.data(), bytes.size()));
+}
+
+bool XenoBytecodeFile::load(const std::string& path, std::vector<XenoInstruction>& bytecode,
+                            std::vector<String>& strings) {
+    XenoMappedFile file;
+    if (!file.open(path)) {
+        Serial.print("ERROR: Cannot open bytecode file ");
+        Serial.println(path.c_str());
+        return false;
+    }
+    return deserialize(file.data(), file.size(), bytecode, strings);
+}
+#undef String
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_RUNTIME_XENO_BYTECODE_FILE_H_
+#define SRC_XENO_RUNTIME_XENO_BYTECODE_FILE_H_
+
+#include <vector>
+#include <string>
+#include "../xeno_common.h"
+#include "arduino_compat.h"
+#define String XenoString
+
+
+// Precompiled program file, little-endian throughout:
+//
+//   header     magic "XENB", u16 version, u16 header size, u32 section
+//              count, u32 flags, u64 FNV-1a checksum of everything after
+//              the header, u32 file size, u32 reserved
+//   directory  per section: u32 type, u32 offset, u32 size, u32 count
+//   CODE       count fixed 8-byte records: u8 opcode, u8 0, u16 arg2, u32 arg1
+//   STRINGS    count (u32 offset, u32 length) pairs, then the string bytes
+//
+// Sections start 8-byte aligned so a mapped file can be read in place.
+// Numeric constants are instruction immediates, so there is no separate
+// constant pool; readers skip section types they do not know.
+class XenoBytecodeFile {
+ public:
+    static constexpr uint32_t MAGIC = 0x424E4558;  // "XENB"
+    static constexpr uint16_t VERSION = 1;
+    static constexpr uint32_t SECTION_CODE = 1;
+    static constexpr uint32_t SECTION_STRINGS = 2;
+
+    static std::string serialize(const std::vector<XenoInstruction>& bytecode,
+                                 const std::vector<String>& strings);
+    // Checks the checksum and every offset before decoding
+    static bool deserialize(const uint8_t* data, size_t size,
+                            std::vector<XenoInstruction>& bytecode, std::vector<String>& strings);
+
+    static bool save(const std::string& path, const std::vector<XenoInstruction>& bytecode,
+                     const std::vector<String>& strings);
+    // Maps the file and decodes it without an intermediate read buffer
+    static bool load(const std::string& path, std::vector<XenoInstruction>& bytecode,
+                     std::vector<String>& strings);
+};
+
+#undef String
+#endif  // SRC_XENO_RUNTIME_XENO_BYTECODE_FILE_H_
@@ -0,0 +1,287 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <filesystem>
+#include <utility>
+#include "xeno_checkpoint.h"
+#include "xeno_binary_io.h"
+#include "xeno_mapped_file.h"
+#define String XenoString
+
+namespace {
+
+void writeValue(XenoByteWriter& out, const XenoValue& value) {
+    out.writeU8(static_cast<uint8_t>(value.type));
+    switch (value.type) {
+        case TYPE_INT: out.writeU32(static_cast<uint32_t>(value.int_val)); break;
+        case TYPE_FLOAT: {
+            uint32_t bits;
+            memcpy(&bits, &value.float_val, sizeof(bits));
+            out.writeU32(bits);
+            break;
+        }
+        case TYPE_STRING: out.writeU32(value.string_index); break;
+        case TYPE_BOOL: out.writeU32(value.bool_val ? 1 : 0); break;
+        default: out.writeU32(0); break;
+    }
+}
+
+bool readValue(XenoByteReader& in, size_t string_count, XenoValue& value) {
+    uint8_t type = in.readU8();
+    uint32_t payload = in.readU32();
+    if (!in.ok()) return false;
+
+    switch (type) {
+        case TYPE_INT:
+            value = XenoValue::makeInt(static_cast<int32_t>(payload));
+            return true;
+        case TYPE_FLOAT: {
+            float f;
+            memcpy(&f, &payload, sizeof(f));
+            value = XenoValue::makeFloat(f);
+            return true;
+        }
+        case TYPE_STRING:
+            if (payload >= string_count) return false;
+            value = XenoValue::makeString(static_cast<uint16_t>(payload));
+            return true;
+        case TYPE_BOOL:
+            value = XenoValue::makeBool(payload != 0);
+            return true;
+        default:
+            return false;
+    }
+}
+
+}  // namespace
+
+uint64_t XenoCheckpoint::programHash(const std::vector<XenoInstruction>& program,
+                                     const std::vector<String>& strings, size_t string_count) {
+    XenoByteWriter bytes;
+    for (const XenoInstruction& instr : program) {
+        bytes.writeU8(instr.opcode);
+        bytes.writeU32(instr.arg1);
+        bytes.writeU16(instr.arg2);
+    }
+    for (size_t i = 0; i < string_count && i < strings.size(); ++i) {
+        bytes.writeString(strings[i].c_str(), strings[i].length());
+    }
+    return xenoHash64(bytes.data().data(), bytes.size());
+}
+
+std::string XenoCheckpoint::serialize(const XenoVMSnapshot& snapshot) {
+    const std::vector<String>& strings = *snapshot.string_table;
+    const std::map<String, XenoValue>& variables = *snapshot.variables;
+    size_t base_count = min(static_cast<size_t>(snapshot.base_string_count), strings.size());
+
+    XenoByteWriter out;
+    out.writeU32(MAGIC);
+    out.writeU16(VERSION);
+    out.writeU16(0);
+    out.writeU64(programHash(*snapshot.program, strings, base_count));
+    out.writeU32(snapshot.program->size());
+    out.writeU32(base_count);
+    out.writeU32(snapshot.program_counter);
+    out.writeU32(snapshot.instruction_count);
+    out.writeU32(snapshot.iteration_count);
+    out.writeU32(strings.size() - base_count);
+    out.writeU32(snapshot.stack.size());
+    out.writeU32(variables.size());
+
+    for (size_t i = base_count; i < strings.size(); ++i) {
+        out.writeString(strings[i].c_str(), strings[i].length());
+    }
+    for (const XenoValue& value : snapshot.stack) {
+        writeValue(out, value);
+    }
+    for (const auto& var : variables) {
+        out.writeString(var.first.c_str(), var.first.length());
+        writeValue(out, var.second);
+    }
+
+    out.writeU64(xenoHash64(out.data().data(), out.size()));
+    return out.take();
+}
+
+bool XenoCheckpoint::deserialize(const uint8_t* data, size_t size,
+                                 const XenoVMSnapshot& base, XenoVMSnapshot& out) {
+    if (size < 8) {
+        Serial.println("ERROR: Checkpoint is truncated");
+        return false;
+    }
+    XenoByteReader trailer(data + size - 8, 8);
+    if (trailer.readU64() != xenoHash64(data, size - 8)) {
+        Serial.println("ERROR: Checkpoint checksum mismatch");
+        return false;
+    }
+
+    XenoByteReader in(data, size - 8);
+    if (in.readU32() != MAGIC || in.readU16() != VERSION) {
+        Serial.println("ERROR: Not a checkpoint or unsupported version");
+        return false;
+    }
+    in.readU16();
+
+    uint64_t program_hash = in.readU64();
+    uint32_t program_size = in.readU32();
+    uint32_t base_count = in.readU32();
+    if (program_size != base.program->size() || base_count != base.base_string_count ||
+        program_hash != programHash(*base.program, *base.string_table, base_count)) {
+        Serial.println("ERROR: Checkpoint belongs to a different program");
+        return false;
+    }
+
+    out.program = base.program;
+    out.string_table = base.string_table;
+    out.string_lookup = base.string_lookup;
+    out.base_string_count = base_count;
+    out.program_counter = in.readU32();
+    out.instruction_count = in.readU32();
+    out.iteration_count = in.readU32();
+    uint32_t runtime_strings = in.readU32();
+    uint32_t stack_size = in.readU32();
+    uint32_t variable_count = in.readU32();
+
+    // Every entry takes at least 4 bytes, so counts are bounded by the file size
+    if (!in.ok() || out.program_counter >= program_size ||
+        runtime_strings > in.remaining() / 4 || base_count + runtime_strings > 65535 ||
+        stack_size > in.remaining() / 5 || variable_count > in.remaining() / 9) {
+        Serial.println("ERROR: Checkpoint header is corrupt");
+        return false;
+    }
+
+    if (runtime_strings > 0) {
+        std::vector<String>& table = out.string_table.write();
+        XenoStringIndex& lookup = out.string_lookup.write();
+        std::string text;
+        for (uint32_t i = 0; i < runtime_strings && in.readString(text); ++i) {
+            table.push_back(text);
+            lookup.insert(table, table.size() - 1);
+        }
+    }
+
+    size_t string_count = out.string_table->size();
+    out.stack.resize(stack_size);
+    for (XenoValue& value : out.stack) {
+        if (!readValue(in, string_count, value)) {
+            Serial.println("ERROR: Checkpoint stack is corrupt");
+            return false;
+        }
+    }
+
+    std::map<String, XenoValue>& variables = out.variables.write();
+    variables.clear();
+    std::string name;
+    for (uint32_t i = 0; i < variable_count; ++i) {
+        XenoValue value;
+        if (!in.readString(name) || !readValue(in, string_count, value)) {
+            Serial.println("ERROR: Checkpoint variables are corrupt");
+            return false;
+        }
+        variables[name] = value;
+    }
+
+    if (!in.ok() || in.remaining() != 0) {
+        Serial.println("ERROR: Checkpoint is corrupt");
+        return false;
+    }
+    return true;
+}
+
+bool XenoCheckpoint::writeFile(const std::string& path, const XenoVMSnapshot& snapshot) {
+    std::string bytes = serialize(snapshot);
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.write(bytes.data(), bytes.size())) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    return !ec;
+}
+
+bool XenoCheckpoint::loadFile(const std::string& path, const XenoVMSnapshot& base, XenoVMSnapshot& out) {
+    XenoMappedFile file;
+    if (!file.open(path)) {
+        Serial.print("ERROR: Cannot open checkpoint ");
+        Serial.println(path.c_str());
+        return false;
+    }
+    return deserialize(file.data(), file.size(), base, out);
+}
+
+XenoCheckpointWriter::XenoCheckpointWriter()
+    : worker(&XenoCheckpointWriter::workerLoop, this) {}
+
+XenoCheckpointWriter::~XenoCheckpointWriter() {
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+void XenoCheckpointWriter::submit(const std::string& path,
+                                  std::shared_ptr<const XenoVMSnapshot> snapshot) {
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        pending_path = path;
+        pending = std::move(snapshot);
+    }
+    work_cv.notify_one();
+}
+
+bool XenoCheckpointWriter::flush() {
+    std::unique_lock<std::mutex> lk(mutex);
+    done_cv.wait(lk, [this] { return !pending && !writing; });
+    return last_ok;
+}
+
+uint32_t XenoCheckpointWriter::getWrittenCount() {
+    std::lock_guard<std::mutex> lk(mutex);
+    return written_count;
+}
+
+void XenoCheckpointWriter::workerLoop() {
+    std::unique_lock<std::mutex> lk(mutex);
+    for (;;) {
+        work_cv.wait(lk, [this] { return stopping || pending; });
+        if (!pending) return;
+
+        std::string path = std::move(pending_path);
+        std::shared_ptr<const XenoVMSnapshot> snapshot = std::move(pending);
+        pending.reset();
+        writing = true;
+
+        lk.unlock();
+        bool ok = XenoCheckpoint::writeFile(path, *snapshot);
+        if (!ok) {
+            Serial.print("ERROR: Could not write checkpoint ");
+            Serial.println(path.c_str());
+        }
+        lk.lock();
+
+        writing = false;
+        last_ok = ok;
+        if (ok) ++written_count;
+        done_cv.notify_all();
+    }
+}
+#undef String
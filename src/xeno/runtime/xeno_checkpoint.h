@@ -0,0 +1,85 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_RUNTIME_XENO_CHECKPOINT_H_
+#define SRC_XENO_RUNTIME_XENO_CHECKPOINT_H_
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "../main/xeno_vm.h"
+#include "arduino_compat.h"
+#define String XenoString
+
+
+// On-disk checkpoint of a running VM. Only live state is stored: PC,
+// counters, stack, variables and strings created at run time. The program
+// is identified by its hash, so a checkpoint resumes on the same compiled
+// program and restoring costs time proportional to the live state.
+class XenoCheckpoint {
+ public:
+    static constexpr uint32_t MAGIC = 0x504B4358;  // "XCKP"
+    static constexpr uint16_t VERSION = 1;
+
+    // Hash of the bytecode and the first string_count strings of the table
+    static uint64_t programHash(const std::vector<XenoInstruction>& program,
+                                const std::vector<String>& strings, size_t string_count);
+
+    static std::string serialize(const XenoVMSnapshot& snapshot);
+    // base is the freshly loaded program the checkpoint must belong to
+    static bool deserialize(const uint8_t* data, size_t size,
+                            const XenoVMSnapshot& base, XenoVMSnapshot& out);
+
+    // Writes through a temporary file so a crash never leaves a torn checkpoint
+    static bool writeFile(const std::string& path, const XenoVMSnapshot& snapshot);
+    // Maps the file and decodes it in place
+    static bool loadFile(const std::string& path, const XenoVMSnapshot& base, XenoVMSnapshot& out);
+};
+
+// Saves checkpoints on a background thread. Only the newest pending one is
+// kept, so a slow disk never makes the VM wait or queues up stale states.
+class XenoCheckpointWriter {
+ private:
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    std::string pending_path;
+    std::shared_ptr<const XenoVMSnapshot> pending;
+    bool writing = false;
+    bool stopping = false;
+    bool last_ok = true;
+    uint32_t written_count = 0;
+
+    void workerLoop();
+
+ public:
+    XenoCheckpointWriter();
+    ~XenoCheckpointWriter();
+    XenoCheckpointWriter(const XenoCheckpointWriter&) = delete;
+    XenoCheckpointWriter& operator=(const XenoCheckpointWriter&) = delete;
+
+    void submit(const std::string& path, std::shared_ptr<const XenoVMSnapshot> snapshot);
+    // Waits for pending writes; returns whether the last one succeeded
+    bool flush();
+    uint32_t getWrittenCount();
+};
+
+#undef String
+#endif  // SRC_XENO_RUNTIME_XENO_CHECKPOINT_H_
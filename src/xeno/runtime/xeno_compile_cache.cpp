@@ -0,0 +1,188 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include "xeno_compile_cache.h"
+#include "xeno_binary_io.h"
+#include "xeno_bytecode_file.h"
+#include "xeno_mapped_file.h"
+#define String XenoString
+
+namespace {
+const uint32_t CACHE_FILE_MAGIC = 0x45434358;  // "XCCE"
+const uint32_t CACHE_FILE_VERSION = 2;
+
+// Numbers the temporary files of concurrent writers
+std::atomic<uint64_t> temp_counter{0};
+
+// The optimizer counters, in file order
+template <typename S, typename F>
+void forEachCounter(S& stats, F visit) {
+    visit(stats.folded);
+    visit(stats.propagated);
+    visit(stats.simplified);
+    visit(stats.branches);
+    visit(stats.threaded);
+    visit(stats.hoisted);
+    visit(stats.reused);
+    visit(stats.combined);
+    visit(stats.removed);
+    visit(stats.arithmetic);
+    visit(stats.specialized);
+}
+}
+
+XenoCompileCache::XenoCompileCache(size_t max_entries, const std::string& directory)
+    : capacity(max_entries > 0 ? max_entries : 1), disk_dir(directory) {
+    stats.capacity = capacity;
+}
+
+XenoCompileCache::Key XenoCompileCache::makeKey(const std::string& source,
+                                                const std::string& config_fingerprint) {
+    // Two independently seeded hashes give a 128-bit key
+    Key key;
+    key.high = xenoHash64(config_fingerprint.data(), config_fingerprint.size());
+    key.high = xenoHash64(source.data(), source.size(), key.high);
+    key.low = xenoHash64(config_fingerprint.data(), config_fingerprint.size(), 0x9E3779B97F4A7C15ull);
+    key.low = xenoHash64(source.data(), source.size(), key.low);
+    return key;
+}
+
+std::shared_ptr<const XenoCompileCache::Entry> XenoCompileCache::lookup(const Key& key,
+                                                                        const Verifier& verify) {
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            ++stats.memory_hits;
+            return it->second->second;
+        }
+    }
+
+    std::shared_ptr<const Entry> entry = disk_dir.empty() ? nullptr : readDisk(key, verify);
+
+    std::lock_guard<std::mutex> lk(mutex);
+    if (!entry) {
+        ++stats.misses;
+        return nullptr;
+    }
+    ++stats.disk_hits;
+    insertLocked(key, entry);
+    return entry;
+}
+
+void XenoCompileCache::store(const Key& key, std::shared_ptr<const Entry> entry) {
+    if (!disk_dir.empty()) writeDisk(key, *entry);
+    std::lock_guard<std::mutex> lk(mutex);
+    insertLocked(key, std::move(entry));
+}
+
+void XenoCompileCache::clear() {
+    std::lock_guard<std::mutex> lk(mutex);
+    lru.clear();
+    index.clear();
+}
+
+XenoCompileCache::Stats XenoCompileCache::getStats() {
+    std::lock_guard<std::mutex> lk(mutex);
+    Stats result = stats;
+    result.entries = lru.size();
+    return result;
+}
+
+void XenoCompileCache::insertLocked(const Key& key, std::shared_ptr<const Entry> entry) {
+    auto it = index.find(key);
+    if (it != index.end()) {
+        it->second->second = std::move(entry);
+        lru.splice(lru.begin(), lru, it->second);
+        return;
+    }
+
+    lru.emplace_front(key, std::move(entry));
+    index[key] = lru.begin();
+    while (lru.size() > capacity) {
+        index.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+std::string XenoCompileCache::pathFor(const Key& key) const {
+    char name[40];
+    snprintf(name, sizeof(name), "%016llx%016llx.xcc",
+             static_cast<unsigned long long>(key.high), static_cast<unsigned long long>(key.low));
+    return (std::filesystem::path(disk_dir) / name).string();
+}
+
+std::shared_ptr<const XenoCompileCache::Entry> XenoCompileCache::readDisk(const Key& key,
+                                                                          const Verifier& verify) const {
+    XenoMappedFile file;
+    if (!file.open(pathFor(key))) return nullptr;
+
+    XenoByteReader in(file.data(), file.size());
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    if (in.readU32() != CACHE_FILE_MAGIC || in.readU32() != CACHE_FILE_VERSION ||
+        !in.readString(entry->diagnostics)) {
+        return nullptr;
+    }
+    forEachCounter(entry->optimizer_stats, [&in](size_t& counter) { counter = in.readU32(); });
+    if (!in.ok()) return nullptr;
+    if (!XenoBytecodeFile::deserialize(file.data() + in.position(), in.remaining(),
+                                       entry->bytecode, entry->strings)) {
+        return nullptr;
+    }
+    if (verify && !verify(*entry)) return nullptr;
+    return entry;
+}
+
+void XenoCompileCache::writeDisk(const Key& key, const Entry& entry) const {
+    // Best effort: a failed write only costs a recompile later
+    std::error_code ec;
+    std::filesystem::create_directories(disk_dir, ec);
+    if (ec) return;
+
+    XenoByteWriter out;
+    out.writeU32(CACHE_FILE_MAGIC);
+    out.writeU32(CACHE_FILE_VERSION);
+    out.writeString(entry.diagnostics.data(), entry.diagnostics.size());
+    forEachCounter(entry.optimizer_stats,
+                   [&out](size_t counter) { out.writeU32(static_cast<uint32_t>(counter)); });
+    std::string program = XenoBytecodeFile::serialize(entry.bytecode, entry.strings);
+    out.writeBytes(program.data(), program.size());
+
+    // Workers storing the same key each write their own file, so only a
+    // complete one is ever renamed into place
+    std::string path = pathFor(key);
+    std::string temp_path = path + "." +
+        std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "." +
+        std::to_string(temp_counter.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+    bool written;
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        written = static_cast<bool>(file.write(out.data().data(), out.size()));
+    }
+    if (written) std::filesystem::rename(temp_path, path, ec);
+    if (!written || ec) std::filesystem::remove(temp_path, ec);
+}
+#undef String
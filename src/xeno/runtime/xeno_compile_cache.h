@@ -0,0 +1,98 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_RUNTIME_XENO_COMPILE_CACHE_H_
+#define SRC_XENO_RUNTIME_XENO_COMPILE_CACHE_H_
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include "../xeno_common.h"
+#include "../main/xeno_optimizer.h"
+#include "arduino_compat.h"
+#define String XenoString
+
+
+// Content-addressed cache of compiled and verified programs. Keys hash the
+// source text together with the security limits it was compiled under.
+// Entries live in an in-memory LRU and, when a directory is given, on disk
+// so they survive host restarts. Safe to share between engines and threads.
+class XenoCompileCache {
+ public:
+    static constexpr size_t DEFAULT_CAPACITY = 64;
+
+    struct Key {
+        uint64_t high = 0;
+        uint64_t low = 0;
+        bool operator==(const Key& other) const { return high == other.high && low == other.low; }
+    };
+
+    struct Entry {
+        std::vector<XenoInstruction> bytecode;
+        std::vector<String> strings;
+        // Compiler messages, replayed on every hit
+        std::string diagnostics;
+        XenoOptimizer::Stats optimizer_stats;
+    };
+
+    struct Stats {
+        uint64_t memory_hits = 0;
+        uint64_t disk_hits = 0;
+        uint64_t misses = 0;
+        size_t entries = 0;
+        size_t capacity = 0;
+    };
+
+    // Entries read from disk are only accepted if this returns true
+    typedef std::function<bool(const Entry&)> Verifier;
+
+ private:
+    struct KeyHash {
+        size_t operator()(const Key& key) const { return static_cast<size_t>(key.low ^ key.high); }
+    };
+    typedef std::list<std::pair<Key, std::shared_ptr<const Entry>>> LruList;
+
+    LruList lru;
+    std::unordered_map<Key, LruList::iterator, KeyHash> index;
+    std::mutex mutex;
+    size_t capacity;
+    std::string disk_dir;
+    Stats stats;
+
+    void insertLocked(const Key& key, std::shared_ptr<const Entry> entry);
+    std::string pathFor(const Key& key) const;
+    std::shared_ptr<const Entry> readDisk(const Key& key, const Verifier& verify) const;
+    void writeDisk(const Key& key, const Entry& entry) const;
+
+ public:
+    // An empty disk_dir keeps the cache in memory only
+    explicit XenoCompileCache(size_t max_entries = DEFAULT_CAPACITY, const std::string& directory = "");
+
+    static Key makeKey(const std::string& source, const std::string& config_fingerprint);
+
+    // Returns nullptr on a miss
+    std::shared_ptr<const Entry> lookup(const Key& key, const Verifier& verify);
+    void store(const Key& key, std::shared_ptr<const Entry> entry);
+    void clear();
+    Stats getStats();
+};
+
+#undef String
+#endif  // SRC_XENO_RUNTIME_XENO_COMPILE_CACHE_H_
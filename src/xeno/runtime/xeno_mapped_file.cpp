@@ -0,0 +1,112 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "xeno_mapped_file.h"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#define String XenoString
+
+XenoMappedFile::~XenoMappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+bool XenoMappedFile::open(const std::string& path) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        return false;
+    }
+    file_handle = file;
+    opened = true;
+    if (file_size.QuadPart == 0) return true;
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        close();
+        return false;
+    }
+    mapping_handle = mapping;
+
+    view = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (view == nullptr) {
+        close();
+        return false;
+    }
+    length = static_cast<size_t>(file_size.QuadPart);
+    return true;
+}
+
+void XenoMappedFile::close() {
+    if (view) UnmapViewOfFile(view);
+    if (mapping_handle) CloseHandle(static_cast<HANDLE>(mapping_handle));
+    if (file_handle) CloseHandle(static_cast<HANDLE>(file_handle));
+    view = nullptr;
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+    length = 0;
+    opened = false;
+}
+#else
+bool XenoMappedFile::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    opened = true;
+    if (info.st_size == 0) {
+        ::close(fd);
+        return true;
+    }
+
+    void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        opened = false;
+        return false;
+    }
+    view = static_cast<const uint8_t*>(mapped);
+    length = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void XenoMappedFile::close() {
+    if (view) munmap(const_cast<uint8_t*>(view), length);
+    view = nullptr;
+    length = 0;
+    opened = false;
+}
+#endif
+#undef String
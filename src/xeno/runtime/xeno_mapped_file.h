@@ -0,0 +1,54 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_RUNTIME_XENO_MAPPED_FILE_H_
+#define SRC_XENO_RUNTIME_XENO_MAPPED_FILE_H_
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include "arduino_compat.h"
+#define String XenoString
+
+
+// Read-only memory mapping of a whole file
+class XenoMappedFile {
+ private:
+    const uint8_t* view = nullptr;
+    size_t length = 0;
+    bool opened = false;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#endif
+
+ public:
+    XenoMappedFile() = default;
+    ~XenoMappedFile();
+    XenoMappedFile(const XenoMappedFile&) = delete;
+    XenoMappedFile& operator=(const XenoMappedFile&) = delete;
+
+    // An empty file opens successfully with size() 0 and no mapping
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return opened; }
+    const uint8_t* data() const { return view; }
+    size_t size() const { return length; }
+};
+
+#undef String
+#endif  // SRC_XENO_RUNTIME_XENO_MAPPED_FILE_H_
@@ -0,0 +1,261 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utility>
+#include <exception>
+#include "xeno_scheduler.h"
+#include "xeno_thread_pool.h"
+#define String XenoString
+
+XenoScheduler::Task::Task(XenoScheduler* scheduler, TaskId task_id, uint8_t prio,
+                          const std::string& src)
+    : id(task_id),
+      priority(prio),
+      source(src),
+      owner(scheduler),
+      io([this](const std::string& text) { emitOutput(text); }),
+      engine(io) {}
+
+void XenoScheduler::Task::emitOutput(const std::string& text) {
+    line_buffer += text;
+    size_t start = 0;
+    size_t newline = line_buffer.find('\n');
+    while (newline != std::string::npos) {
+        if (owner->output_handler) {
+            owner->output_handler(id, line_buffer.substr(start, newline - start));
+        }
+        start = newline + 1;
+        newline = line_buffer.find('\n', start);
+    }
+    line_buffer.erase(0, start);
+}
+
+void XenoScheduler::Task::flushOutput() {
+    if (!line_buffer.empty() && owner->output_handler) {
+        owner->output_handler(id, line_buffer);
+    }
+    line_buffer.clear();
+}
+
+XenoScheduler::XenoScheduler(size_t thread_count, uint32_t quantum_instructions)
+    : quantum(quantum_instructions > 0 ? quantum_instructions : DEFAULT_QUANTUM) {
+    if (thread_count == 0) thread_count = XenoThreadPool::defaultThreadCount();
+    workers.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers.emplace_back(&XenoScheduler::workerLoop, this);
+    }
+}
+
+XenoScheduler::~XenoScheduler() {
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    for (std::thread& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+void XenoScheduler::setOutputHandler(OutputHandler handler) {
+    std::lock_guard<std::mutex> lk(mutex);
+    output_handler = std::move(handler);
+}
+
+void XenoScheduler::setCompletionHandler(CompletionHandler handler) {
+    std::lock_guard<std::mutex> lk(mutex);
+    completion_handler = std::move(handler);
+}
+
+XenoScheduler::TaskId XenoScheduler::spawn(const XenoLanguage& prototype,
+                                           const std::string& source, uint8_t priority) {
+    priority = min(max(priority, MIN_PRIORITY), MAX_PRIORITY);
+
+    std::lock_guard<std::mutex> lk(mutex);
+    TaskId id = next_task_id++;
+    std::unique_ptr<Task> task(new Task(this, id, priority, source));
+    task->engine.copySecurityConfig(prototype);
+    task->engine.setOptimizationLevel(prototype.getOptimizationLevel());
+    Task* raw = task.get();
+    tasks[id] = std::move(task);
+    makeReady(raw);
+    return id;
+}
+
+bool XenoScheduler::pushInput(TaskId id, const std::string& line) {
+    std::lock_guard<std::mutex> lk(mutex);
+    auto it = tasks.find(id);
+    if (it == tasks.end() || it->second->state == TASK_FINISHED) return false;
+
+    Task* task = it->second.get();
+    task->io.pushInput(line);
+    if (task->state == TASK_WAITING_INPUT) {
+        makeReady(task);
+    }
+    return true;
+}
+
+bool XenoScheduler::kill(TaskId id) {
+    std::lock_guard<std::mutex> lk(mutex);
+    auto it = tasks.find(id);
+    if (it == tasks.end() || it->second->state == TASK_FINISHED) return false;
+
+    Task* task = it->second.get();
+    task->killed = true;
+    if (task->state == TASK_SLEEPING || task->state == TASK_WAITING_INPUT) {
+        makeReady(task);
+    }
+    return true;
+}
+
+std::vector<XenoScheduler::TaskInfo> XenoScheduler::listTasks() {
+    std::lock_guard<std::mutex> lk(mutex);
+    std::vector<TaskInfo> result;
+    result.reserve(tasks.size());
+    for (const auto& entry : tasks) {
+        const Task& task = *entry.second;
+        result.push_back({task.id, task.priority, task.state, task.instruction_count});
+    }
+    return result;
+}
+
+size_t XenoScheduler::activeTaskCount() {
+    std::lock_guard<std::mutex> lk(mutex);
+    return tasks.size();
+}
+
+void XenoScheduler::waitAll() {
+    std::unique_lock<std::mutex> lk(mutex);
+    done_cv.wait(lk, [this] { return tasks.empty(); });
+}
+
+const char* XenoScheduler::taskStateName(TaskState state) {
+    switch (state) {
+        case TASK_READY: return "ready";
+        case TASK_RUNNING: return "running";
+        case TASK_SLEEPING: return "sleeping";
+        case TASK_WAITING_INPUT: return "waiting for input";
+        case TASK_FINISHED: return "finished";
+        default: return "unknown";
+    }
+}
+
+void XenoScheduler::makeReady(Task* task) {
+    // A task coming back from sleep must not outrun the others with its
+    // stale virtual runtime, so it rejoins at the current minimum.
+    task->state = TASK_READY;
+    ++task->timer_generation;
+    task->vruntime = max(task->vruntime, min_vruntime);
+    ready_queue.push({task->vruntime, ready_sequence++, task});
+    work_cv.notify_one();
+}
+
+void XenoScheduler::releaseDueTimers() {
+    Clock::time_point now = Clock::now();
+    while (!timer_queue.empty() && timer_queue.top().due <= now) {
+        TimerEntry entry = timer_queue.top();
+        timer_queue.pop();
+
+        auto it = tasks.find(entry.task_id);
+        if (it == tasks.end()) continue;
+        Task* task = it->second.get();
+        if (task->timer_generation != entry.generation) continue;
+        if (task->state == TASK_SLEEPING || task->state == TASK_WAITING_INPUT) {
+            makeReady(task);
+        }
+    }
+}
+
+XenoYieldReason XenoScheduler::runTask(Task& task) {
+    if (task.killed) return YIELD_HALT;
+
+    try {
+        if (!task.started) {
+            task.started = true;
+            task.engine.compile(task.source);
+            if (!task.engine.start()) return YIELD_HALT;
+        }
+        return task.engine.runSlice(quantum);
+    } catch (const std::exception& ex) {
+        task.emitOutput(std::string("Runtime error: ") + ex.what() + "\n");
+    } catch (...) {
+        task.emitOutput("Unknown runtime error occurred in task\n");
+    }
+    return YIELD_HALT;
+}
+
+void XenoScheduler::finishTask(Task* task, std::unique_lock<std::mutex>& lk) {
+    task->state = TASK_FINISHED;
+    TaskId id = task->id;
+    CompletionHandler on_complete = completion_handler;
+
+    lk.unlock();
+    task->flushOutput();
+    if (on_complete) on_complete(id);
+    lk.lock();
+
+    tasks.erase(id);
+    done_cv.notify_all();
+}
+
+void XenoScheduler::workerLoop() {
+    std::unique_lock<std::mutex> lk(mutex);
+    while (!stopping) {
+        releaseDueTimers();
+        if (ready_queue.empty()) {
+            if (timer_queue.empty()) {
+                work_cv.wait(lk);
+            } else {
+                work_cv.wait_until(lk, timer_queue.top().due);
+            }
+            continue;
+        }
+
+        Task* task = ready_queue.top().task;
+        ready_queue.pop();
+        min_vruntime = task->vruntime;
+        task->state = TASK_RUNNING;
+
+        lk.unlock();
+        uint32_t before = task->engine.getInstructionCount();
+        XenoYieldReason reason = runTask(*task);
+        uint32_t executed = task->engine.getInstructionCount() - before;
+        lk.lock();
+
+        // Charge at least one unit so yielding tasks cannot run for free
+        task->instruction_count = task->engine.getInstructionCount();
+        task->vruntime += (static_cast<uint64_t>(executed) + 1) * 1024 / task->priority;
+
+        if (reason == YIELD_HALT || task->killed) {
+            finishTask(task, lk);
+            continue;
+        }
+
+        if (reason == YIELD_QUANTUM ||
+            (reason == YIELD_INPUT && task->io.hasInput())) {
+            makeReady(task);
+            continue;
+        }
+
+        task->state = (reason == YIELD_SLEEP) ? TASK_SLEEPING : TASK_WAITING_INPUT;
+        long long remaining = static_cast<long long>(task->engine.getWakeTime()) -
+                              static_cast<long long>(task->io.millis());
+        Clock::time_point due = Clock::now() + std::chrono::milliseconds(max(remaining, 0LL));
+        timer_queue.push({due, ++task->timer_generation, task->id});
+        work_cv.notify_one();
+    }
+}
+#undef String
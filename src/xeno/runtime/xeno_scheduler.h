@@ -0,0 +1,153 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_RUNTIME_XENO_SCHEDULER_H_
+#define SRC_XENO_RUNTIME_XENO_SCHEDULER_H_
+
+#include <vector>
+#include <queue>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include "../../XenoLanguage.h"
+#include "arduino_compat.h"
+#define String XenoString
+
+
+// Green-thread scheduler: time-slices many engines over a few OS threads.
+// A task runs for one fuel quantum at a time; DELAY parks it on the timer
+// queue and INPUT parks it until a line arrives or the input timeout fires.
+// Ready tasks are picked by weighted virtual runtime, so every task makes
+// progress and higher priorities get proportionally more quanta.
+class XenoScheduler {
+ public:
+    typedef uint32_t TaskId;
+    typedef std::function<void(TaskId, const std::string&)> OutputHandler;
+    typedef std::function<void(TaskId)> CompletionHandler;
+
+    static constexpr uint8_t MIN_PRIORITY = 1;
+    static constexpr uint8_t MAX_PRIORITY = 10;
+    static constexpr uint8_t DEFAULT_PRIORITY = 5;
+    static constexpr uint32_t DEFAULT_QUANTUM = 1000;
+
+    enum TaskState {
+        TASK_READY,
+        TASK_RUNNING,
+        TASK_SLEEPING,
+        TASK_WAITING_INPUT,
+        TASK_FINISHED
+    };
+
+    struct TaskInfo {
+        TaskId id;
+        uint8_t priority;
+        TaskState state;
+        uint32_t instruction_count;
+    };
+
+ private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Task {
+        TaskId id;
+        uint8_t priority;
+        std::string source;
+        XenoScheduler* owner;
+        std::string line_buffer;
+        XenoBufferedIO io;
+        XenoLanguage engine;
+        TaskState state = TASK_READY;
+        bool started = false;
+        bool killed = false;
+        uint64_t vruntime = 0;
+        uint64_t timer_generation = 0;
+        uint32_t instruction_count = 0;
+
+        Task(XenoScheduler* scheduler, TaskId task_id, uint8_t prio, const std::string& src);
+        void emitOutput(const std::string& text);
+        void flushOutput();
+    };
+
+    struct ReadyEntry {
+        uint64_t vruntime;
+        uint64_t sequence;
+        Task* task;
+        bool operator>(const ReadyEntry& other) const {
+            return vruntime != other.vruntime ? vruntime > other.vruntime
+                                              : sequence > other.sequence;
+        }
+    };
+
+    // Timers refer to tasks by id because a killed task may be gone when it fires
+    struct TimerEntry {
+        Clock::time_point due;
+        uint64_t generation;
+        TaskId task_id;
+        bool operator>(const TimerEntry& other) const { return due > other.due; }
+    };
+
+    std::map<TaskId, std::unique_ptr<Task>> tasks;
+    std::priority_queue<ReadyEntry, std::vector<ReadyEntry>, std::greater<ReadyEntry>> ready_queue;
+    std::priority_queue<TimerEntry, std::vector<TimerEntry>, std::greater<TimerEntry>> timer_queue;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    OutputHandler output_handler;
+    CompletionHandler completion_handler;
+    uint32_t quantum;
+    uint64_t min_vruntime = 0;
+    uint64_t ready_sequence = 0;
+    TaskId next_task_id = 1;
+    bool stopping = false;
+
+    void workerLoop();
+    void makeReady(Task* task);
+    void releaseDueTimers();
+    XenoYieldReason runTask(Task& task);
+    void finishTask(Task* task, std::unique_lock<std::mutex>& lk);
+
+ public:
+    // thread_count 0 uses the number of hardware threads
+    explicit XenoScheduler(size_t thread_count = 0, uint32_t quantum_instructions = DEFAULT_QUANTUM);
+    ~XenoScheduler();
+    XenoScheduler(const XenoScheduler&) = delete;
+    XenoScheduler& operator=(const XenoScheduler&) = delete;
+
+    // Handlers are called from worker threads; output arrives line by line
+    void setOutputHandler(OutputHandler handler);
+    void setCompletionHandler(CompletionHandler handler);
+
+    // The task is compiled and run with the security limits of prototype
+    TaskId spawn(const XenoLanguage& prototype, const std::string& source,
+                 uint8_t priority = DEFAULT_PRIORITY);
+    bool pushInput(TaskId id, const std::string& line);
+    bool kill(TaskId id);
+
+    std::vector<TaskInfo> listTasks();
+    size_t activeTaskCount();
+    void waitAll();
+
+    static const char* taskStateName(TaskState state);
+};
+
+#undef String
+#endif  // SRC_XENO_RUNTIME_XENO_SCHEDULER_H_
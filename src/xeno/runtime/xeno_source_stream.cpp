@@ -0,0 +1,68 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include "xeno_source_stream.h"
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+XenoIStreamSource::XenoIStreamSource(std::istream& input, size_t length)
+    : in(input), remaining(length), bounded(length != UNKNOWN_SIZE),
+      buffer(std::min(length, CHUNK_SIZE)) {}
+
+std::string_view XenoIStreamSource::next() {
+    if (remaining == 0 || read_failed) return std::string_view();
+
+    size_t want = std::min(remaining, buffer.size());
+    in.read(buffer.data(), static_cast<std::streamsize>(want));
+    size_t got = static_cast<size_t>(in.gcount());
+    if (got < want) {
+        // Running out early is only an error when the length was given
+        read_failed = bounded;
+        remaining = 0;
+    } else if (bounded) {
+        remaining -= got;
+    }
+    return std::string_view(buffer.data(), got);
+}
+
+XenoFdSource::XenoFdSource(int file_descriptor)
+    : fd(file_descriptor), buffer(CHUNK_SIZE) {}
+
+std::string_view XenoFdSource::next() {
+    while (!finished) {
+#ifdef _WIN32
+        int got = _read(fd, buffer.data(), static_cast<unsigned int>(buffer.size()));
+#else
+        ssize_t got = ::read(fd, buffer.data(), buffer.size());
+        if (got < 0 && errno == EINTR) continue;
+#endif
+        if (got > 0) return std::string_view(buffer.data(), static_cast<size_t>(got));
+        read_failed = got < 0;
+        finished = true;
+    }
+    return std::string_view();
+}
+
+std::string_view XenoMappedSource::next() {
+    if (delivered || !file.isOpen() || file.size() == 0) return std::string_view();
+    delivered = true;
+    return std::string_view(reinterpret_cast<const char*>(file.data()), file.size());
+}
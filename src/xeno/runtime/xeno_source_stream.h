@@ -0,0 +1,90 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_RUNTIME_XENO_SOURCE_STREAM_H_
+#define SRC_XENO_RUNTIME_XENO_SOURCE_STREAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "xeno_mapped_file.h"
+
+
+// Source text delivered in chunks, so it can be compiled while it is still
+// being read. next() returns the following piece of the source and an
+// empty view at the end; a piece stays valid until the next call.
+class XenoSourceStream {
+ public:
+    static constexpr size_t UNKNOWN_SIZE = SIZE_MAX;
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    virtual ~XenoSourceStream() = default;
+    virtual std::string_view next() = 0;
+    // Length of the rest of the source if known, otherwise UNKNOWN_SIZE
+    virtual size_t sizeHint() const { return UNKNOWN_SIZE; }
+    // True if the source ended early or could not be read
+    virtual bool failed() const { return false; }
+};
+
+// Exactly length bytes of a std::istream, or everything up to its end
+// when length is UNKNOWN_SIZE
+class XenoIStreamSource : public XenoSourceStream {
+ private:
+    std::istream& in;
+    size_t remaining;
+    bool bounded;
+    bool read_failed = false;
+    std::vector<char> buffer;
+
+ public:
+    explicit XenoIStreamSource(std::istream& input, size_t length = UNKNOWN_SIZE);
+    std::string_view next() override;
+    size_t sizeHint() const override { return bounded ? remaining : UNKNOWN_SIZE; }
+    bool failed() const override { return read_failed; }
+};
+
+// Everything readable from a file descriptor until end of file.
+// The descriptor is not owned.
+class XenoFdSource : public XenoSourceStream {
+ private:
+    int fd;
+    bool read_failed = false;
+    bool finished = false;
+    std::vector<char> buffer;
+
+ public:
+    explicit XenoFdSource(int file_descriptor);
+    std::string_view next() override;
+    bool failed() const override { return read_failed; }
+};
+
+// A memory-mapped file, handed out as a single chunk without copying
+class XenoMappedSource : public XenoSourceStream {
+ private:
+    XenoMappedFile file;
+    bool delivered = false;
+
+ public:
+    bool open(const std::string& path) { delivered = false; return file.open(path); }
+    std::string_view next() override;
+    size_t sizeHint() const override { return delivered ? 0 : file.size(); }
+    bool failed() const override { return !file.isOpen(); }
+};
+
+#endif  // SRC_XENO_RUNTIME_XENO_SOURCE_STREAM_H_
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utility>
+#include "xeno_thread_pool.h"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#define String XenoString
+
+namespace {
+// Worker index of the calling thread within its pool, if any
+thread_local const void* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+}
+
+XenoThreadPool::XenoThreadPool(size_t thread_count, QueueMode queue_mode, bool pin_workers)
+    : mode(queue_mode) {
+    if (thread_count == 0) thread_count = defaultThreadCount();
+    size_t queue_count = (mode == QUEUE_WORK_STEALING) ? thread_count : 1;
+    queues.reserve(queue_count);
+    for (size_t i = 0; i < queue_count; ++i) {
+        queues.emplace_back(new WorkerQueue());
+    }
+
+    size_t cpu_count = defaultThreadCount();
+    workers.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers.emplace_back(&XenoThreadPool::workerLoop, this, i);
+        if (pin_workers) pinThread(workers.back(), i % cpu_count);
+    }
+}
+
+XenoThreadPool::~XenoThreadPool() {
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+        stopping = true;
+    }
+    task_cv.notify_all();
+    for (std::thread& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+size_t XenoThreadPool::defaultThreadCount() {
+    unsigned int hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+const char* XenoThreadPool::queueModeName(QueueMode queue_mode) {
+    return queue_mode == QUEUE_WORK_STEALING ? "work-stealing" : "shared";
+}
+
+bool XenoThreadPool::pinThread(std::thread& thread, size_t cpu) {
+#ifdef _WIN32
+    if (cpu >= sizeof(DWORD_PTR) * 8) return false;
+    return SetThreadAffinityMask(thread.native_handle(), static_cast<DWORD_PTR>(1) << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+    (void)thread;
+    (void)cpu;
+    return false;
+#endif
+}
+
+void XenoThreadPool::submit(std::function<void()> task) {
+    size_t target = 0;
+    if (mode == QUEUE_WORK_STEALING) {
+        target = (current_pool == this) ? current_worker
+                                        : next_queue.fetch_add(1) % queues.size();
+    }
+
+    // Counted before it becomes visible so a thief can never take it first
+    pending_tasks.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lk(queues[target]->mutex);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    // Pass through the sleep mutex so a worker that just saw no pending
+    // tasks is already waiting when notified
+    {
+        std::lock_guard<std::mutex> lk(mutex);
+    }
+    task_cv.notify_one();
+}
+
+void XenoThreadPool::waitIdle() {
+    std::unique_lock<std::mutex> lk(mutex);
+    idle_cv.wait(lk, [this] { return pending_tasks.load() == 0 && active_tasks.load() == 0; });
+}
+
+bool XenoThreadPool::popTask(WorkerQueue& queue, bool newest, std::function<void()>& task) {
+    std::lock_guard<std::mutex> lk(queue.mutex);
+    if (queue.tasks.empty()) return false;
+    if (newest) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+    } else {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+    }
+    // Active first so the pool never looks idle while a task changes hands
+    active_tasks.fetch_add(1);
+    pending_tasks.fetch_sub(1);
+    return true;
+}
+
+bool XenoThreadPool::takeTask(size_t index, std::function<void()>& task) {
+    if (mode == QUEUE_SHARED) return popTask(*queues[0], false, task);
+
+    if (popTask(*queues[index], true, task)) return true;
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        if (popTask(*queues[(index + offset) % queues.size()], false, task)) return true;
+    }
+    return false;
+}
+
+void XenoThreadPool::workerLoop(size_t index) {
+    current_pool = this;
+    current_worker = index;
+
+    for (;;) {
+        std::function<void()> task;
+        if (!takeTask(index, task)) {
+            std::unique_lock<std::mutex> lk(mutex);
+            task_cv.wait(lk, [this] { return stopping || pending_tasks.load() > 0; });
+            if (stopping && pending_tasks.load() == 0) return;
+            continue;
+        }
+
+        try {
+            task();
+        } catch (...) {
+            // Tasks report their own errors; keep the worker alive
+        }
+
+        if (active_tasks.fetch_sub(1) == 1 && pending_tasks.load() == 0) {
+            std::lock_guard<std::mutex> lk(mutex);
+            idle_cv.notify_all();
+        }
+    }
+}
+#undef String
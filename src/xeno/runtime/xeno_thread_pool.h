@@ -0,0 +1,86 @@
+/*
+ * Copyright 2025 VL_PLAY Games
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_XENO_RUNTIME_XENO_THREAD_POOL_H_
+#define SRC_XENO_RUNTIME_XENO_THREAD_POOL_H_
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "arduino_compat.h"
+#define String XenoString
+
+
+// Fixed-size worker pool used to run independent engines in parallel.
+// In work-stealing mode every worker owns a deque: it takes its newest task
+// from the back and, when empty, steals the oldest task from another worker.
+// Shared mode keeps one locked FIFO queue and is kept for comparison.
+class XenoThreadPool {
+ public:
+    enum QueueMode {
+        QUEUE_SHARED,
+        QUEUE_WORK_STEALING
+    };
+
+ private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    QueueMode mode;
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::atomic<size_t> pending_tasks{0};
+    std::atomic<size_t> active_tasks{0};
+    std::atomic<size_t> next_queue{0};
+    std::mutex mutex;
+    std::condition_variable task_cv;
+    std::condition_variable idle_cv;
+    bool stopping = false;
+
+    void workerLoop(size_t index);
+    bool takeTask(size_t index, std::function<void()>& task);
+    bool popTask(WorkerQueue& queue, bool newest, std::function<void()>& task);
+
+ public:
+    // thread_count 0 uses the number of hardware threads. With pin_workers
+    // worker i is bound to CPU i modulo the hardware thread count.
+    explicit XenoThreadPool(size_t thread_count = 0, QueueMode queue_mode = QUEUE_WORK_STEALING,
+                            bool pin_workers = false);
+    ~XenoThreadPool();
+    XenoThreadPool(const XenoThreadPool&) = delete;
+    XenoThreadPool& operator=(const XenoThreadPool&) = delete;
+
+    // Tasks submitted from a worker go to that worker's own deque
+    void submit(std::function<void()> task);
+    void waitIdle();
+    size_t size() const { return workers.size(); }
+    QueueMode getQueueMode() const { return mode; }
+
+    static size_t defaultThreadCount();
+    static const char* queueModeName(QueueMode queue_mode);
+    // Returns false where pinning is not supported
+    static bool pinThread(std::thread& thread, size_t cpu);
+};
+
+#undef String
+#endif  // SRC_XENO_RUNTIME_XENO_THREAD_POOL_H_
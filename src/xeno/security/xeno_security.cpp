@@ -18,6 +18,95 @@
 #include "xeno_security.h"
 #define String XenoString
 
+void XenoSecurity::stackEffect(uint8_t opcode, uint32_t& pops, uint32_t& pushes) {
+    pops = 0;
+    pushes = 0;
+    switch (opcode) {
+        case OP_PUSH:
+        case OP_PUSH_FLOAT:
+        case OP_PUSH_STRING:
+        case OP_PUSH_BOOL:
+        case OP_LOAD:
+            pushes = 1;
+            break;
+        case OP_POP:
+        case OP_STORE:
+        case OP_JUMP_IF:
+            pops = 1;
+            break;
+        case OP_PRINT_NUM:
+        case OP_ABS:
+        case OP_SQRT:
+        case OP_SIN:
+        case OP_COS:
+        case OP_TAN:
+        case OP_STORE_KEEP:
+            pops = 1;
+            pushes = 1;
+            break;
+        case OP_DUP:
+            pops = 1;
+            pushes = 2;
+            break;
+        case OP_SWAP:
+            pops = 2;
+            pushes = 2;
+            break;
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_MOD:
+        case OP_POW:
+        case OP_MAX:
+        case OP_MIN:
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_LT:
+        case OP_GT:
+        case OP_LTE:
+        case OP_GTE:
+            pops = 2;
+            pushes = 1;
+            break;
+        default:
+            if (opcode >= OP_ADD_INT && opcode <= OP_GTE_FLOAT) {
+                pops = 2;
+                pushes = 1;
+            }
+            break;
+    }
+}
+
+// An instruction that pops more than is known was given values from
+// before; whatever it pushes is known again, as it only runs if they were
+// there
+std::vector<uint32_t> XenoSecurity::knownStackDepths(const std::vector<XenoInstruction>& bytecode) {
+    std::vector<uint8_t> jump_target(bytecode.size(), 0);
+    for (const XenoInstruction& instr : bytecode) {
+        if ((instr.opcode == OP_JUMP || instr.opcode == OP_JUMP_IF) && instr.arg1 < bytecode.size()) {
+            jump_target[instr.arg1] = 1;
+        }
+    }
+
+    std::vector<uint32_t> depths(bytecode.size(), 0);
+    uint32_t known = 0;
+    for (size_t i = 0; i < bytecode.size(); i++) {
+        if (jump_target[i]) known = 0;
+        depths[i] = known;
+
+        const XenoInstruction& instr = bytecode[i];
+        if (instr.opcode == OP_JUMP || instr.opcode == OP_HALT) {
+            known = 0;
+            continue;
+        }
+        uint32_t pops, pushes;
+        stackEffect(instr.opcode, pops, pushes);
+        known = (known > pops ? known - pops : 0) + pushes;
+    }
+    return depths;
+}
+
 bool XenoSecurity::isPinAllowed(uint8_t pin) {
     const std::vector<uint8_t>& allowed_pins = config.getAllowedPins();
     for (size_t i = 0; i < allowed_pins.size(); i++) {
@@ -57,12 +146,12 @@ String XenoSecurity::sanitizeString(const String& input) {
 
 bool XenoSecurity::verifyBytecode(const std::vector<XenoInstruction>& bytecode,
                                  const std::vector<String>& strings) {
-    if (bytecode.size() > 10000) {
+    if (bytecode.size() > MAX_PROGRAM_SIZE) {
         Serial.println("SECURITY: Program too large");
         return false;
     }
 
-    if (strings.size() > 1000) {
+    if (strings.size() > MAX_STRING_COUNT) {
         Serial.println("SECURITY: String table too large");
         return false;
     }
@@ -70,7 +159,7 @@ bool XenoSecurity::verifyBytecode(const std::vector<XenoInstruction>& bytecode,
     for (size_t i = 0; i < bytecode.size(); i++) {
         const XenoInstruction& instr = bytecode[i];
 
-        if (instr.opcode > 34 && instr.opcode != 255) {
+        if (instr.opcode > OP_STORE_KEEP && instr.opcode != OP_HALT) {
             Serial.print("SECURITY: Invalid opcode at instruction ");
             Serial.println(i);
             return false;
@@ -86,7 +175,7 @@ bool XenoSecurity::verifyBytecode(const std::vector<XenoInstruction>& bytecode,
 
         if (instr.opcode == OP_PRINT || instr.opcode == OP_STORE ||
             instr.opcode == OP_LOAD || instr.opcode == OP_PUSH_STRING ||
-            instr.opcode == OP_INPUT) {
+            instr.opcode == OP_INPUT || instr.opcode == OP_STORE_KEEP) {
             if (instr.arg1 >= strings.size()) {
                 Serial.print("SECURITY: Invalid string index at instruction ");
                 Serial.println(i);
@@ -111,6 +200,19 @@ bool XenoSecurity::verifyBytecode(const std::vector<XenoInstruction>& bytecode,
         }
     }
 
+    // Programs may leave values on the stack for code that is jumped to,
+    // but the optimizer only emits these on values pushed right before
+    std::vector<uint32_t> depths = knownStackDepths(bytecode);
+    for (size_t i = 0; i < bytecode.size(); i++) {
+        uint8_t opcode = bytecode[i].opcode;
+        uint32_t needed = opcode == OP_SWAP ? 2 : (opcode == OP_DUP || opcode == OP_STORE_KEEP) ? 1 : 0;
+        if (depths[i] < needed) {
+            Serial.print("SECURITY: Missing stack operand at instruction ");
+            Serial.println(i);
+            return false;
+        }
+    }
+
     bool has_halt = false;
     for (const auto& instr : bytecode) {
         if (instr.opcode == OP_HALT) {
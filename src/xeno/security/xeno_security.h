@@ -25,6 +25,19 @@
 
 
 class XenoSecurity {
+ public:
+    // Largest program and string table verifyBytecode() accepts
+    static constexpr size_t MAX_PROGRAM_SIZE = 10000;
+    static constexpr size_t MAX_STRING_COUNT = 1000;
+
+    // Values an instruction takes off the stack and puts back on it
+    static void stackEffect(uint8_t opcode, uint32_t& pops, uint32_t& pushes);
+
+    // For each instruction, how many values it is sure to find on the
+    // stack, counting only what was pushed since the last jump target
+    // or unconditional jump
+    static std::vector<uint32_t> knownStackDepths(const std::vector<XenoInstruction>& bytecode);
+
  private:
     XenoSecurityConfig& config;
 
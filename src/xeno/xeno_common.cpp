@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <charconv>
 #include "xeno_common.h"
 #define String XenoString
 
@@ -47,6 +49,108 @@ XenoValue XenoValue::makeBool(bool val) {
     return v;
 }
 
+bool XenoValue::parseNumber(const char* text, size_t length, XenoValue& out) {
+    const char* first = text;
+    const char* last = text + length;
+    while (first < last && isspace(static_cast<unsigned char>(*first))) ++first;
+    while (last > first && isspace(static_cast<unsigned char>(last[-1]))) --last;
+    if (first == last) return false;
+
+    // One sign: '-', or '+' on integers only
+    bool plus = *first == '+';
+    const char* digits = (plus || *first == '-') ? first + 1 : first;
+
+    bool has_digit = false;
+    bool has_decimal = false;
+    for (const char* p = digits; p < last; ++p) {
+        if (*p >= '0' && *p <= '9') {
+            has_digit = true;
+        } else if (*p == '.' && !has_decimal) {
+            has_decimal = true;
+        } else {
+            return false;
+        }
+    }
+    if (!has_digit || (plus && has_decimal)) return false;
+    if (plus) ++first;  // from_chars takes no '+'
+
+    // Out-of-range literals leave the value untouched, i.e. they parse as 0
+    if (has_decimal) {
+        float value = 0.0f;
+        std::from_chars(first, last, value);
+        out = makeFloat(value);
+    } else {
+        int32_t value = 0;
+        std::from_chars(first, last, value);
+        out = makeInt(value);
+    }
+    return true;
+}
+
+bool XenoValue::parseNumber(const String& text, XenoValue& out) {
+    return parseNumber(text.c_str(), text.length(), out);
+}
+
 XenoInstruction::XenoInstruction(uint8_t op, uint32_t a1, uint16_t a2)
     : opcode(op), arg1(a1), arg2(a2) {}
+
+uint32_t XenoStringIndex::hash(std::string_view str) {
+    uint32_t h = 2166136261u;
+    for (char c : str) {
+        h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return h ^ (h >> 16);
+}
+
+int XenoStringIndex::find(const std::vector<String>& table, std::string_view str) const {
+    if (slots.empty()) return -1;
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash(str) & mask; slots[i] != 0; i = (i + 1) & mask) {
+        size_t position = slots[i] - 1;
+        if (position < table.size() && table[position].view() == str) {
+            return static_cast<int>(position);
+        }
+    }
+    return -1;
+}
+
+void XenoStringIndex::place(const std::vector<String>& table, uint16_t position) {
+    size_t mask = slots.size() - 1;
+    size_t i = hash(table[position].view()) & mask;
+    while (slots[i] != 0) i = (i + 1) & mask;
+    slots[i] = position + 1;
+}
+
+void XenoStringIndex::insert(const std::vector<String>& table, uint16_t position) {
+    if (position >= table.size() || position == UINT16_MAX ||
+        find(table, table[position].view()) >= 0) {
+        return;
+    }
+
+    // Kept at most three quarters full so probes stay short
+    if ((count + 1) * 4 > slots.size() * 3) {
+        std::vector<uint16_t> old_slots(std::max<size_t>(16, slots.size() * 2), 0);
+        old_slots.swap(slots);
+        for (uint16_t slot : old_slots) {
+            if (slot != 0) place(table, slot - 1);
+        }
+    }
+    place(table, position);
+    ++count;
+}
+
+void XenoStringIndex::rebuild(const std::vector<String>& table) {
+    clear();
+    size_t capacity = 16;
+    while (capacity * 3 < table.size() * 4) capacity *= 2;
+    slots.assign(capacity, 0);
+    for (size_t i = 0; i < table.size(); ++i) {
+        insert(table, static_cast<uint16_t>(i));
+    }
+}
+
+void XenoStringIndex::clear() {
+    slots.clear();
+    count = 0;
+}
 #undef String
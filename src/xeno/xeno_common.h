@@ -17,6 +17,10 @@
 #ifndef SRC_XENO_XENO_COMMON_H_
 #define SRC_XENO_XENO_COMMON_H_
 
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
 #include "arduino_compat.h"
 #define String XenoString
 
@@ -57,6 +61,32 @@ enum XenoOpcodes {
     OP_SIN = 32,
     OP_COS = 33,
     OP_TAN = 34,
+    // Variants the optimizer emits where both operands are known ints or
+    // known floats; the same results and errors without the type checks
+    OP_ADD_INT = 35,
+    OP_SUB_INT = 36,
+    OP_MUL_INT = 37,
+    OP_DIV_INT = 38,
+    OP_MOD_INT = 39,
+    OP_EQ_INT = 40,
+    OP_NEQ_INT = 41,
+    OP_LT_INT = 42,
+    OP_GT_INT = 43,
+    OP_LTE_INT = 44,
+    OP_GTE_INT = 45,
+    OP_ADD_FLOAT = 46,
+    OP_SUB_FLOAT = 47,
+    OP_MUL_FLOAT = 48,
+    OP_DIV_FLOAT = 49,
+    OP_EQ_FLOAT = 50,
+    OP_NEQ_FLOAT = 51,
+    OP_LT_FLOAT = 52,
+    OP_GT_FLOAT = 53,
+    OP_LTE_FLOAT = 54,
+    OP_GTE_FLOAT = 55,
+    OP_DUP = 56,         // pushes a copy of the top of the stack
+    OP_SWAP = 57,        // exchanges the top two values
+    OP_STORE_KEEP = 58,  // STORE that leaves the value on the stack
     OP_HALT = 255
 };
 
@@ -68,6 +98,14 @@ enum XenoDataType {
     TYPE_BOOL = 3
 };
 
+// Why a cooperative run slice returned control to the scheduler
+enum XenoYieldReason {
+    YIELD_QUANTUM = 0,
+    YIELD_SLEEP = 1,
+    YIELD_INPUT = 2,
+    YIELD_HALT = 3
+};
+
 // Value structure that can hold different data types
 struct XenoValue {
     XenoDataType type;
@@ -84,6 +122,11 @@ struct XenoValue {
     static XenoValue makeFloat(float val);
     static XenoValue makeString(uint16_t str_idx);
     static XenoValue makeBool(bool val);
+
+    // Classifies and parses a numeric literal in one pass. Returns false if
+    // the text is not a number, otherwise out holds a TYPE_INT or TYPE_FLOAT.
+    static bool parseNumber(const char* text, size_t length, XenoValue& out);
+    static bool parseNumber(const String& text, XenoValue& out);
 };
 
 // Bytecode instruction structure
@@ -97,6 +140,52 @@ struct XenoInstruction {
                          uint16_t a2 = 0);
 };
 
+// Copy-on-write holder: copies share one T until one of them calls write()
+template <typename T>
+class XenoCow {
+ private:
+    std::shared_ptr<T> data;
+
+ public:
+    XenoCow() : data(std::make_shared<T>()) {}
+
+    const T& operator*() const { return *data; }
+    const T* operator->() const { return data.get(); }
+
+    void reset(T value = T()) { data = std::make_shared<T>(std::move(value)); }
+
+    T& write() {
+        if (data.use_count() > 1) data = std::make_shared<T>(*data);
+        return *data;
+    }
+};
+
+// Hash index over a string table: maps contents to their position without
+// storing the strings again. Compiler and VM use the same index, so a
+// compiled program is loaded without rebuilding it.
+class XenoStringIndex {
+ public:
+    // Position of str in table, or -1 if it is not indexed
+    int find(const std::vector<String>& table, std::string_view str) const;
+    // Indexes table[position]; of equal strings the first indexed one is kept
+    void insert(const std::vector<String>& table, uint16_t position);
+    void rebuild(const std::vector<String>& table);
+    void clear();
+    void swap(XenoStringIndex& other) {
+        slots.swap(other.slots);
+        std::swap(count, other.count);
+    }
+    size_t size() const { return count; }
+
+ private:
+    // Open addressing with linear probing; slots hold position + 1, 0 is empty
+    std::vector<uint16_t> slots;
+    size_t count = 0;
+
+    static uint32_t hash(std::string_view str);
+    void place(const std::vector<String>& table, uint16_t position);
+};
+
 // Structure for storing information about loop
 struct LoopInfo {
     String var_name;
@@ -13,7 +13,12 @@
 #include <cstring>
 #include <fstream>
 #include <filesystem>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <algorithm>
 #include "src/XenoLanguage.h"
+#include "src/xeno/runtime/xeno_scheduler.h"
 
 namespace fs = std::filesystem;
 static uint32_t g_max_instructions = 100000;
@@ -34,6 +39,102 @@ static bool read_exact(std::istream& in, std::string& out, size_t n) {
     return true;
 }
 
+// Batch job wire format: <source length>\n<source>\n<input line count>\n<input lines>
+// Counts come from the wire and are checked against these caps.
+static const size_t MAX_BATCH_JOBS = 10000;
+static const size_t MAX_BATCH_INPUT_LINES = 100000;
+
+static bool read_batch_job(std::istream& in, XenoBatchJob& job, bool& bad_count) {
+    std::string line;
+    if (!std::getline(in, line)) return false;
+    size_t length = 0;
+    try {
+        length = std::stoull(line);
+    } catch (...) {
+        return false;
+    }
+    if (!read_exact(in, job.source, length)) return false;
+    if (in.peek() == '\n') in.get();
+
+    if (!std::getline(in, line)) return false;
+    size_t input_count = 0;
+    try {
+        input_count = std::stoull(line);
+    } catch (...) {
+        return false;
+    }
+    if (input_count > MAX_BATCH_INPUT_LINES) {
+        bad_count = true;
+        return false;
+    }
+    job.input.clear();
+    for (size_t i = 0; i < input_count; ++i) {
+        if (!std::getline(in, line)) return false;
+        job.input.push_back(line);
+    }
+    return true;
+}
+
+// BENCH_POOL workload: mostly tiny programs plus a few that run close to
+// the VM iteration limit. The seed is fixed so runs are comparable.
+static std::vector<XenoBatchJob> make_pool_benchmark_jobs(size_t job_count, unsigned long_percent) {
+    std::mt19937 rng(20251127);
+    std::uniform_int_distribution<unsigned> roll(0, 99);
+    std::vector<XenoBatchJob> jobs(job_count);
+    for (XenoBatchJob& job : jobs) {
+        unsigned iterations = roll(rng) < long_percent ? 7000 : 10;
+        job.source = "set s 0\nfor i = 1 to " + std::to_string(iterations) +
+                     "\nset s s + i\nendfor\nprint $s\n";
+    }
+    return jobs;
+}
+
+// BENCH_COMPILE workload: a long program mixing the statement kinds and
+// nested expressions, with a bounded set of variables and strings
+static std::string make_compile_benchmark_source(size_t line_count) {
+    std::string source;
+    source.reserve(line_count * 32);
+    size_t lines = 0;
+    for (size_t block = 0; lines < line_count; ++block) {
+        std::string n = std::to_string(block);
+        std::string v = "v" + std::to_string(block % 64);
+        std::string w = "w" + std::to_string(block % 32);
+        source += "set " + v + " " + n + "\n";
+        source += "set " + w + " (" + v + " * 3 + abs(" + v + " - " + n + ")) % 11 // mix\n";
+        source += "if " + w + " >= max(" + v + ", " + n + ") then\n";
+        source += "print \"block " + n + "\"\n";
+        source += "else\n";
+        source += "for i = 1 to sqrt(" + w + " + " + n + ")\n";
+        source += "set " + v + " " + v + " + i ^ 2 - M_PI * " + n + "\n";
+        source += "endfor\n";
+        source += "endif\n";
+        source += "print $" + v + "\n";
+        lines += 10;
+    }
+    return source;
+}
+
+static std::string describe_pool_run(const char* name, const std::vector<XenoBatchResult>& results,
+                                      double total_ms) {
+    std::vector<double> latencies;
+    latencies.reserve(results.size());
+    for (const XenoBatchResult& result : results) {
+        latencies.push_back(result.latency_ms);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        size_t rank = static_cast<size_t>(p * latencies.size() + 0.5);
+        return latencies[min(max(rank, static_cast<size_t>(1)), latencies.size()) - 1];
+    };
+
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(2) << name << ": "
+         << (results.size() * 1000.0 / max(total_ms, 0.001)) << " jobs/s, latency p50 "
+         << percentile(0.50) << " ms, p95 " << percentile(0.95) << " ms, p99 "
+         << percentile(0.99) << " ms, max " << latencies.back() << " ms";
+    return line.str();
+}
+
 int main() {
     std::ios::sync_with_stdio(false);
     std::cin.tie(nullptr);
@@ -77,15 +178,52 @@ int main() {
         infoFile << "SUPPORT_MAX_IF_DEPTH\n";
         infoFile << "SUPPORT_MAX_STACK_SIZE\n";
         infoFile << "SUPPORT_ALLOWED_PINS\n";
+        infoFile << "SUPPORT_RUN_BATCH\n";
+        infoFile << "SUPPORT_TASKS\n";
+        infoFile << "SUPPORT_BENCH_POOL\n";
+        infoFile << "SUPPORT_BENCH_COMPILE\n";
+        infoFile << "SUPPORT_SNAPSHOT\n";
+        infoFile << "SUPPORT_CHECKPOINT\n";
+        infoFile << "SUPPORT_BYTECODE_FILES\n";
+        infoFile << "SUPPORT_CACHE_STATS\n";
+        infoFile << "SUPPORT_COMPILE_FILE\n";
+        infoFile << "SUPPORT_COMPILE_THREADS\n";
+        infoFile << "SUPPORT_OPTIMIZER\n";
 
         infoFile.close();
     }
 
-    auto send_line = [](const std::string& s) {
+    // Compiled programs are cached by source and security limits, in memory
+    // and next to the info file so repeated COMPILEs survive restarts
+    XenoCompileCache compile_cache(XenoCompileCache::DEFAULT_CAPACITY,
+                                   (filePath.parent_path() / "xeno_cache").string());
+    engine.setCompileCache(&compile_cache);
+
+    auto send_line = [&ioMutex](const std::string& s) {
+        std::lock_guard<std::mutex> lk(ioMutex);
         std::cout << s << std::endl;
         std::cout.flush();
     };
 
+    // Set by SNAPSHOT; every CLONE_RUN starts from a copy of it
+    std::shared_ptr<const XenoVMSnapshot> snapshot;
+
+    // Tasks started with SPAWN share a few scheduler threads instead of
+    // holding one OS thread each; created on first use.
+    std::unique_ptr<XenoScheduler> scheduler;
+    auto get_scheduler = [&scheduler, &send_line]() -> XenoScheduler& {
+        if (!scheduler) {
+            scheduler.reset(new XenoScheduler());
+            scheduler->setOutputHandler([&send_line](XenoScheduler::TaskId id, const std::string& line) {
+                send_line("[task " + std::to_string(id) + "] " + line);
+            });
+            scheduler->setCompletionHandler([&send_line](XenoScheduler::TaskId id) {
+                send_line("=== Task " + std::to_string(id) + " completed ===");
+            });
+        }
+        return *scheduler;
+    };
+
     while (running.load()) {
         std::string cmd;
         if (!std::getline(std::cin, cmd)) {
@@ -106,28 +244,94 @@ int main() {
                 continue;
             }
 
-            std::string src;
-            if (!read_exact(std::cin, src, N)) {
-                send_line("Could not read source code");
-                continue;
-            }
-            if (std::cin.peek() == '\n') std::cin.get();
-
             try {
                 engine.setMaxInstructions(g_max_instructions);
-                
+
+                // Large sources are compiled while the rest is still arriving
+                XenoIStreamSource src(std::cin, N);
                 bool ok = engine.compile(src);
+                if (src.failed()) {
+                    send_line("Could not read source code");
+                    continue;
+                }
+                if (std::cin.peek() == '\n') std::cin.get();
+
+                if (ok) {
+                    send_line("Compilation successful!");
+                } else {
+                    send_line("Compilation failed - check your code for errors");
+                }
+            } catch (const std::exception& ex) {
+                send_line(std::string("Compilation error: ") + ex.what());
+            } catch (...) {
+                send_line("Unknown compilation error occurred");
+            }
+        }
+        else if (cmd.rfind("COMPILE_FILE ", 0) == 0) {
+            try {
+                engine.setMaxInstructions(g_max_instructions);
+
+                XenoSourceFileStats stats;
+                auto start = std::chrono::steady_clock::now();
+                bool ok = engine.compileFile(cmd.substr(13), &stats);
+                double elapsed_ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+
                 if (ok) {
                     send_line("Compilation successful!");
                 } else {
                     send_line("Compilation failed - check your code for errors");
                 }
+                std::ostringstream line;
+                line << std::fixed << std::setprecision(2) << "Compiled " << stats.files
+                     << " file(s), " << stats.lines << " lines, " << (stats.bytes / 1024.0)
+                     << " KB in " << elapsed_ms << " ms";
+                send_line(line.str());
             } catch (const std::exception& ex) {
                 send_line(std::string("Compilation error: ") + ex.what());
             } catch (...) {
                 send_line("Unknown compilation error occurred");
             }
         }
+        else if (cmd.rfind("SET_COMPILE_THREADS ", 0) == 0) {
+            try {
+                engine.setCompileThreads(std::stoul(cmd.substr(20)));
+                send_line("Compile threads set to " + std::to_string(engine.getCompileThreads()));
+            } catch (...) {
+                send_line("Invalid value for compile threads");
+            }
+        }
+        else if (cmd.rfind("SET_OPTIMIZATION_LEVEL ", 0) == 0) {
+            try {
+                unsigned long level = std::stoul(cmd.substr(23));
+                if (level <= XenoLanguage::getMaxOptimizationLevel()) {
+                    engine.setOptimizationLevel(static_cast<uint8_t>(level));
+                    send_line("Optimization level set to " + std::to_string(level));
+                } else {
+                    send_line("Optimization level must be 0.." +
+                              std::to_string(XenoLanguage::getMaxOptimizationLevel()));
+                }
+            } catch (...) {
+                send_line("Invalid value for optimization level");
+            }
+        }
+        else if (cmd == "OPTIMIZER_STATS") {
+            const XenoOptimizer::Stats& stats = engine.getOptimizerStats();
+            send_line("Optimization level " + std::to_string(engine.getOptimizationLevel()) + ": " +
+                      std::to_string(stats.folded) + " operations folded, " +
+                      std::to_string(stats.propagated) + " constants propagated, " +
+                      std::to_string(stats.simplified) + " identities removed, " +
+                      std::to_string(stats.branches) + " branches resolved, " +
+                      std::to_string(stats.threaded) + " jumps threaded, " +
+                      std::to_string(stats.hoisted) + " loop invariants hoisted, " +
+                      std::to_string(stats.reused) + " repeated expressions reused, " +
+                      std::to_string(stats.combined) + " instruction sequences combined, " +
+                      std::to_string(stats.removed) + " instructions removed");
+            size_t percent = stats.arithmetic ? stats.specialized * 100 / stats.arithmetic : 0;
+            send_line(std::to_string(stats.specialized) + " of " + std::to_string(stats.arithmetic) +
+                      " arithmetic operations specialized to int or float (" +
+                      std::to_string(percent) + "%)");
+        }
         else if (cmd == "RUN") {
             try {
                 if (vm_running.load()) {
@@ -165,6 +369,108 @@ int main() {
             }
         }
 
+        else if (cmd == "CACHE_STATS") {
+            XenoCompileCache::Stats stats = compile_cache.getStats();
+            std::ostringstream line;
+            line << "Compile cache: " << (stats.memory_hits + stats.disk_hits) << " hits ("
+                 << stats.memory_hits << " memory, " << stats.disk_hits << " disk), "
+                 << stats.misses << " misses, " << stats.entries << "/" << stats.capacity << " entries";
+            send_line(line.str());
+            XenoLineCache::Stats lines = engine.getLineCacheStats();
+            send_line("Line cache: " + std::to_string(lines.reused_lines) + " lines reused, " +
+                      std::to_string(lines.compiled_lines) + " compiled in last compile, " +
+                      std::to_string(lines.entries) + " cached");
+            send_line("Module cache: " + std::to_string(engine.getModuleCacheSize()) + " modules");
+        }
+        else if (cmd == "CACHE_CLEAR") {
+            compile_cache.clear();
+            send_line("Compile cache cleared");
+        }
+        else if (cmd.rfind("SAVE_BYTECODE ", 0) == 0) {
+            try {
+                if (engine.saveBytecode(cmd.substr(14))) {
+                    send_line("Bytecode saved");
+                } else {
+                    send_line("Failed to save bytecode");
+                }
+            } catch (...) {
+                send_line("Unknown error while saving bytecode");
+            }
+        }
+        else if (cmd.rfind("LOAD_BYTECODE ", 0) == 0) {
+            if (vm_running.load()) {
+                send_line("VM already running");
+                continue;
+            }
+            try {
+                if (engine.loadBytecode(cmd.substr(14))) {
+                    send_line("Bytecode loaded");
+                } else {
+                    send_line("Failed to load bytecode");
+                }
+            } catch (...) {
+                send_line("Unknown error while loading bytecode");
+            }
+        }
+        else if (cmd.rfind("RESUME ", 0) == 0) {
+            std::string path = cmd.substr(7);
+            try {
+                if (vm_running.load()) {
+                    send_line("VM already running");
+                } else {
+                    vm_running = true;
+                    std::lock_guard<std::mutex> lk(vmThreadMutex);
+                    if (vmThread.joinable()) {
+                        try { vmThread.join(); } catch(...) {}
+                    }
+                    vmThread = std::thread([&engine, &vm_running, &send_line, path]() {
+                        try {
+                            engine.setMaxInstructions(g_max_instructions);
+                            if (!engine.resumeFromCheckpoint(path)) {
+                                send_line("Failed to resume from checkpoint");
+                            }
+                            send_line("=== Execution completed ===");
+                        } catch (const std::exception& ex) {
+                            send_line(std::string("Runtime error: ") + ex.what());
+                        } catch (...) {
+                            send_line("Unknown runtime error occurred in VM thread");
+                        }
+                        vm_running = false;
+                    });
+                }
+            } catch (const std::exception& ex) {
+                send_line(std::string("Runtime error starting VM: ") + ex.what());
+            } catch (...) {
+                send_line("Unknown runtime error occurred starting VM");
+            }
+        }
+        else if (cmd.rfind("CHECKPOINT ", 0) == 0) {
+            if (!vm_running.load()) {
+                send_line("VM is not running");
+                continue;
+            }
+            engine.requestCheckpoint(cmd.substr(11));
+            send_line("Checkpoint requested");
+        }
+        else if (cmd.rfind("CHECKPOINT_EVERY ", 0) == 0) {
+            if (vm_running.load()) {
+                send_line("VM already running");
+                continue;
+            }
+            std::stringstream args(cmd.substr(17));
+            uint32_t interval = 0;
+            std::string path;
+            if (!(args >> interval) || (interval > 0 && !(args >> path))) {
+                send_line("Invalid arguments. Use: CHECKPOINT_EVERY <instructions> <path>");
+                continue;
+            }
+            engine.setCheckpointInterval(interval, path);
+            send_line(interval > 0 ? "Checkpoint interval set to " + std::to_string(interval)
+                                   : std::string("Periodic checkpoints disabled"));
+        }
+        else if (cmd == "FLUSH_CHECKPOINTS") {
+            send_line(engine.flushCheckpoints() ? "Checkpoints written" : "Checkpoint write failed");
+        }
         else if (cmd == "STOP") {
             try {
                 engine.stop();
@@ -417,6 +723,296 @@ int main() {
                 send_line("Missing pin list");
             }
         }
+        else if (cmd == "RUN_BATCH") {
+            std::string header;
+            if (!std::getline(std::cin, header)) {
+                send_line("Missing batch header");
+                continue;
+            }
+            size_t job_count = 0;
+            size_t worker_count = 0;
+            std::stringstream hs(header);
+            if (!(hs >> job_count) || job_count == 0 || job_count > MAX_BATCH_JOBS) {
+                send_line("Invalid batch header. Use: job_count [worker_count]");
+                continue;
+            }
+            hs >> worker_count;
+
+            try {
+                std::vector<XenoBatchJob> jobs;
+                bool read_ok = true;
+                bool bad_count = false;
+                for (size_t i = 0; i < job_count && read_ok; ++i) {
+                    XenoBatchJob job;
+                    read_ok = read_batch_job(std::cin, job, bad_count);
+                    if (read_ok) jobs.push_back(std::move(job));
+                }
+                if (bad_count) {
+                    send_line("Invalid batch header. Use: job_count [worker_count]");
+                    continue;
+                }
+                if (!read_ok) {
+                    send_line("Could not read batch jobs");
+                    continue;
+                }
+
+                engine.setMaxInstructions(g_max_instructions);
+                auto start = std::chrono::steady_clock::now();
+                std::vector<XenoBatchResult> results = engine.runBatch(jobs, worker_count);
+                double total_ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+
+                for (size_t i = 0; i < results.size(); ++i) {
+                    std::ostringstream head;
+                    head << "=== Job " << (i + 1) << "/" << results.size()
+                         << " (" << results[i].instruction_count << " instructions, "
+                         << std::fixed << std::setprecision(2) << results[i].elapsed_ms << " ms) ===";
+                    send_line(head.str());
+                    std::lock_guard<std::mutex> lk(ioMutex);
+                    std::cout << results[i].output;
+                }
+                std::ostringstream summary;
+                summary << "=== Batch completed: " << results.size() << " jobs in "
+                        << std::fixed << std::setprecision(2) << total_ms << " ms ===";
+                send_line(summary.str());
+            } catch (const std::exception& ex) {
+                send_line(std::string("Batch error: ") + ex.what());
+            } catch (...) {
+                send_line("Unknown error while running batch");
+            }
+        }
+        else if (cmd == "BENCH_POOL" || cmd.rfind("BENCH_POOL ", 0) == 0) {
+            size_t job_count = 200;
+            size_t worker_count = 0;
+            unsigned long_percent = 10;
+            int pin = 0;
+            std::stringstream args(cmd.size() > 10 ? cmd.substr(11) : "");
+            args >> job_count >> worker_count >> long_percent >> pin;
+            if (job_count == 0 || long_percent > 100) {
+                send_line("Invalid arguments. Use: BENCH_POOL [jobs] [workers] [long_percent] [pin]");
+                continue;
+            }
+            if (worker_count == 0) worker_count = XenoThreadPool::defaultThreadCount();
+
+            try {
+                std::vector<XenoBatchJob> jobs = make_pool_benchmark_jobs(job_count, long_percent);
+                std::ostringstream head;
+                head << "=== Pool benchmark: " << job_count << " jobs (" << long_percent
+                     << "% long), " << worker_count << " workers"
+                     << (pin ? ", pinned" : "") << " ===";
+                send_line(head.str());
+
+                const XenoThreadPool::QueueMode modes[] = {
+                    XenoThreadPool::QUEUE_SHARED, XenoThreadPool::QUEUE_WORK_STEALING
+                };
+                for (XenoThreadPool::QueueMode mode : modes) {
+                    auto start = std::chrono::steady_clock::now();
+                    std::vector<XenoBatchResult> results = engine.runBatch(jobs, worker_count, mode, pin != 0);
+                    double total_ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start).count();
+                    send_line(describe_pool_run(XenoThreadPool::queueModeName(mode), results, total_ms));
+                }
+            } catch (const std::exception& ex) {
+                send_line(std::string("Benchmark error: ") + ex.what());
+            } catch (...) {
+                send_line("Unknown error while running benchmark");
+            }
+        }
+        else if (cmd == "BENCH_COMPILE" || cmd.rfind("BENCH_COMPILE ", 0) == 0) {
+            size_t line_count = 10000;
+            std::stringstream args(cmd.size() > 13 ? cmd.substr(14) : "");
+            args >> line_count;
+            if (line_count == 0) {
+                send_line("Invalid arguments. Use: BENCH_COMPILE [lines]");
+                continue;
+            }
+
+            try {
+                std::string source = make_compile_benchmark_source(line_count);
+                // Separate engine without the compile cache so every pass compiles
+                XenoBufferedIO quiet;
+                XenoLanguage bench(quiet);
+                bench.copySecurityConfig(engine);
+                bench.setOptimizationLevel(engine.getOptimizationLevel());
+                XenoLanguage parallel_bench(quiet);
+                parallel_bench.copySecurityConfig(engine);
+                parallel_bench.setOptimizationLevel(engine.getOptimizationLevel());
+                parallel_bench.setCompileThreads(0);
+
+                auto timed_compile = [](XenoLanguage& target, const std::string& src) {
+                    auto start = std::chrono::steady_clock::now();
+                    target.compile(src);
+                    return std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start).count();
+                };
+
+                double full_ms = timed_compile(bench, source);
+                double parallel_ms = timed_compile(parallel_bench, source);
+                // One edited line in the middle; the rest comes from the line cache
+                std::string edited = source;
+                size_t middle = edited.find("print \"block", edited.size() / 2);
+                if (middle != std::string::npos) edited.insert(middle + 7, "edited ");
+                double edit_ms = timed_compile(bench, edited);
+
+                std::ostringstream line;
+                line << std::fixed << std::setprecision(2) << "Compile benchmark: " << line_count
+                     << " lines, " << (source.size() / 1024.0) << " KB in " << full_ms << " ms ("
+                     << (line_count * 1000.0 / max(full_ms, 0.001)) << " lines/s, "
+                     << (source.size() / 1048.576 / max(full_ms, 0.001)) << " MB/s); "
+                     << parallel_bench.getCompileThreads() << " threads " << parallel_ms
+                     << " ms; one-line edit " << edit_ms << " ms";
+                send_line(line.str());
+            } catch (const std::exception& ex) {
+                send_line(std::string("Benchmark error: ") + ex.what());
+            } catch (...) {
+                send_line("Unknown error while running benchmark");
+            }
+        }
+        else if (cmd == "SNAPSHOT" || cmd.rfind("SNAPSHOT ", 0) == 0) {
+            if (vm_running.load()) {
+                send_line("VM already running");
+                continue;
+            }
+            try {
+                uint32_t pc = engine.findFirstInput();
+                if (cmd.size() > 8) pc = static_cast<uint32_t>(std::stoul(cmd.substr(9)));
+
+                engine.setMaxInstructions(g_max_instructions);
+                std::shared_ptr<const XenoVMSnapshot> taken = engine.snapshotAt(pc);
+                std::cout.flush();
+                if (taken) {
+                    snapshot = taken;
+                    send_line("Snapshot taken at PC " + std::to_string(pc));
+                } else {
+                    send_line("Snapshot failed");
+                }
+            } catch (const std::exception& ex) {
+                send_line(std::string("Snapshot error: ") + ex.what());
+            } catch (...) {
+                send_line("Invalid snapshot address. Use: SNAPSHOT [pc]");
+            }
+        }
+        else if (cmd == "CLONE_RUN") {
+            std::string countLine;
+            size_t input_count = 0;
+            if (!std::getline(std::cin, countLine)) {
+                send_line("Missing input line count");
+                continue;
+            }
+            try {
+                input_count = std::stoull(countLine);
+            } catch (...) {
+                send_line("Invalid input line count");
+                continue;
+            }
+
+            XenoBufferedIO io;
+            std::string line;
+            bool read_ok = true;
+            for (size_t i = 0; i < input_count && read_ok; ++i) {
+                read_ok = static_cast<bool>(std::getline(std::cin, line));
+                if (read_ok) io.pushInput(line);
+            }
+            io.closeInput();
+            if (!read_ok) {
+                send_line("Could not read clone input");
+                continue;
+            }
+            if (!snapshot) {
+                send_line("No snapshot. Use SNAPSHOT first");
+                continue;
+            }
+
+            try {
+                auto start = std::chrono::steady_clock::now();
+                XenoLanguage clone(io);
+                clone.copySecurityConfig(engine);
+                bool ok = clone.runFromSnapshot(*snapshot);
+                double elapsed_ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count();
+
+                {
+                    std::lock_guard<std::mutex> lk(ioMutex);
+                    std::cout << io.takeOutput();
+                }
+                std::ostringstream summary;
+                summary << "=== Clone " << (ok ? "completed" : "failed") << " ("
+                        << clone.getInstructionCount() << " instructions, "
+                        << std::fixed << std::setprecision(2) << elapsed_ms << " ms) ===";
+                send_line(summary.str());
+            } catch (const std::exception& ex) {
+                send_line(std::string("Runtime error: ") + ex.what());
+            } catch (...) {
+                send_line("Unknown runtime error occurred in clone");
+            }
+        }
+        else if (cmd == "SPAWN") {
+            std::string header;
+            if (!std::getline(std::cin, header)) {
+                send_line("Missing source code length");
+                continue;
+            }
+            size_t N = 0;
+            int priority = XenoScheduler::DEFAULT_PRIORITY;
+            std::stringstream hs(header);
+            if (!(hs >> N)) {
+                send_line("Invalid length format");
+                continue;
+            }
+            hs >> priority;
+            priority = max(min(priority, static_cast<int>(XenoScheduler::MAX_PRIORITY)),
+                           static_cast<int>(XenoScheduler::MIN_PRIORITY));
+
+            std::string src;
+            if (!read_exact(std::cin, src, N)) {
+                send_line("Could not read source code");
+                continue;
+            }
+            if (std::cin.peek() == '\n') std::cin.get();
+
+            try {
+                engine.setMaxInstructions(g_max_instructions);
+                XenoScheduler::TaskId id = get_scheduler().spawn(engine, src, static_cast<uint8_t>(priority));
+                send_line("Task " + std::to_string(id) + " spawned");
+            } catch (const std::exception& ex) {
+                send_line(std::string("Error spawning task: ") + ex.what());
+            } catch (...) {
+                send_line("Unknown error while spawning task");
+            }
+        }
+        else if (cmd.rfind("TASK_STDIN ", 0) == 0) {
+            std::string rest = cmd.substr(11);
+            size_t space = rest.find(' ');
+            try {
+                XenoScheduler::TaskId id = static_cast<XenoScheduler::TaskId>(std::stoul(rest.substr(0, space)));
+                std::string payload = (space == std::string::npos) ? "" : rest.substr(space + 1);
+                if (!scheduler || !scheduler->pushInput(id, payload)) {
+                    send_line("Unknown task: " + std::to_string(id));
+                }
+            } catch (...) {
+                send_line("Invalid task input. Use: TASK_STDIN <id> <data>");
+            }
+        }
+        else if (cmd.rfind("TASK_KILL ", 0) == 0) {
+            try {
+                XenoScheduler::TaskId id = static_cast<XenoScheduler::TaskId>(std::stoul(cmd.substr(10)));
+                if (!scheduler || !scheduler->kill(id)) {
+                    send_line("Unknown task: " + std::to_string(id));
+                }
+            } catch (...) {
+                send_line("Invalid task id. Use: TASK_KILL <id>");
+            }
+        }
+        else if (cmd == "TASK_LIST") {
+            std::vector<XenoScheduler::TaskInfo> tasks;
+            if (scheduler) tasks = scheduler->listTasks();
+            send_line("Tasks: " + std::to_string(tasks.size()));
+            for (const XenoScheduler::TaskInfo& info : tasks) {
+                send_line("  " + std::to_string(info.id) + ": " + XenoScheduler::taskStateName(info.state) +
+                          ", priority " + std::to_string(info.priority) +
+                          ", " + std::to_string(info.instruction_count) + " instructions");
+            }
+        }
         else if (cmd == "EXIT") {
             send_line("Exiting");
             try {